@@ -0,0 +1,66 @@
+import struct
+import sys
+
+import numpy as np
+import tensorflow as tf
+
+# Write a trained Keras Sequential model in the weight format read by
+# imgproc/cnn.h (load_model), so net1.exe --classify can score images without
+# TensorFlow:
+#
+#     python export_weights.py skin_cancer_detection_model.keras model.bin
+
+LAYER_CONV2D = 1
+LAYER_MAXPOOL = 2
+LAYER_FLATTEN = 3
+LAYER_DENSE = 4
+ACTIVATIONS = {'linear': 0, 'relu': 1, 'sigmoid': 2}
+
+
+def _activation(layer):
+    name = layer.activation.__name__
+    if name not in ACTIVATIONS:
+        raise ValueError(f'{layer.name}: unsupported activation {name}')
+    return ACTIVATIONS[name]
+
+
+def _layer_record(layer, out):
+    if isinstance(layer, tf.keras.layers.Conv2D):
+        if layer.strides != (1, 1) or layer.padding != 'valid' or layer.dilation_rate != (1, 1):
+            raise ValueError(f'{layer.name}: only stride 1, valid padding convolutions are supported')
+        kernel, bias = layer.get_weights()
+        out.write(struct.pack('<6I', LAYER_CONV2D, _activation(layer), *kernel.shape))
+    elif isinstance(layer, tf.keras.layers.MaxPooling2D):
+        if layer.strides != layer.pool_size or layer.padding != 'valid':
+            raise ValueError(f'{layer.name}: only non-overlapping valid pooling is supported')
+        out.write(struct.pack('<6I', LAYER_MAXPOOL, 0, *layer.pool_size, 0, 0))
+        return
+    elif isinstance(layer, tf.keras.layers.Flatten):
+        out.write(struct.pack('<6I', LAYER_FLATTEN, 0, 0, 0, 0, 0))
+        return
+    elif isinstance(layer, tf.keras.layers.Dense):
+        kernel, bias = layer.get_weights()
+        out.write(struct.pack('<6I', LAYER_DENSE, _activation(layer), *kernel.shape, 0, 0))
+    elif isinstance(layer, tf.keras.layers.Dropout):
+        return  # identity at inference
+    else:
+        raise ValueError(f'{layer.name}: unsupported layer {type(layer).__name__}')
+    out.write(np.ascontiguousarray(kernel, dtype='<f4').tobytes())
+    out.write(np.ascontiguousarray(bias, dtype='<f4').tobytes())
+
+
+def export(model, path):
+    layers = [l for l in model.layers if not isinstance(l, tf.keras.layers.Dropout)]
+    height, width, channels = model.input_shape[1:]
+    with open(path, 'wb') as out:
+        out.write(b'CNNW')
+        out.write(struct.pack('<5I', 1, height, width, channels, len(layers)))
+        for layer in layers:
+            _layer_record(layer, out)
+
+
+if __name__ == '__main__':
+    model_path = sys.argv[1] if len(sys.argv) > 1 else 'skin_cancer_detection_model.keras'
+    output_path = sys.argv[2] if len(sys.argv) > 2 else 'model.bin'
+    export(tf.keras.models.load_model(model_path), output_path)
+    print(f'Wrote {output_path}')
@@ -0,0 +1,104 @@
+import ctypes
+import os
+
+import numpy as np
+
+
+class LoaderOptions(ctypes.Structure):
+    # Mirrors struct LoaderOptions in imgproc/loader.h
+    _fields_ = [
+        ('batch_size', ctypes.c_int),
+        ('size', ctypes.c_int),
+        ('workers', ctypes.c_int),
+        ('prefetch', ctypes.c_int),
+        ('shuffle', ctypes.c_int),
+        ('seed', ctypes.c_uint),
+        ('flip_horizontal', ctypes.c_int),
+        ('flip_vertical', ctypes.c_int),
+        ('quarter_turns', ctypes.c_int),
+        ('max_rotation', ctypes.c_float),
+        ('min_scale', ctypes.c_float),
+        ('max_scale', ctypes.c_float),
+        ('max_brightness', ctypes.c_int),
+        ('max_contrast', ctypes.c_float),
+    ]
+
+
+def _load_library(path):
+    lib = ctypes.CDLL(path)
+    lib.loader_default_options.argtypes = [ctypes.POINTER(LoaderOptions)]
+    lib.loader_open.argtypes = [ctypes.c_char_p, ctypes.POINTER(LoaderOptions)]
+    lib.loader_open.restype = ctypes.c_void_p
+    lib.loader_close.argtypes = [ctypes.c_void_p]
+    for name in ('loader_samples', 'loader_batches_per_epoch', 'loader_classes'):
+        getattr(lib, name).argtypes = [ctypes.c_void_p]
+        getattr(lib, name).restype = ctypes.c_int
+    lib.loader_class_name.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.loader_class_name.restype = ctypes.c_char_p
+    lib.loader_next.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+    lib.loader_next.restype = ctypes.c_int
+    return lib
+
+
+class AugmentedLoader:
+    """Shuffled, augmented batches decoded by the C++ worker pool.
+
+    Replaces ImageDataGenerator(rescale=1./255).flow_from_directory(...):
+
+        train = AugmentedLoader('../melanomaDataset/melanoma_cancer_dataset/train')
+        model.fit(train.batches(), steps_per_epoch=len(train), epochs=15)
+
+    Keyword arguments override the fields of LoaderOptions; augment=False
+    turns off every augmentation (for validation and test data).
+    """
+
+    def __init__(self, root, library=None, augment=True, **options):
+        if library is None:
+            library = os.environ.get('IMGPROC_LIBRARY', os.path.join(os.path.dirname(__file__), '..', 'libimgproc.so'))
+        self._lib = _load_library(library)
+
+        self.options = LoaderOptions()
+        self._lib.loader_default_options(ctypes.byref(self.options))
+        if not augment:
+            self.options.flip_horizontal = self.options.flip_vertical = self.options.quarter_turns = 0
+            self.options.max_rotation = self.options.max_brightness = self.options.max_contrast = 0
+            self.options.min_scale = self.options.max_scale = 1
+        for name, value in options.items():
+            setattr(self.options, name, value)
+
+        self._handle = self._lib.loader_open(root.encode(), ctypes.byref(self.options))
+        if not self._handle:
+            raise RuntimeError('Could not open dataset ' + root)
+        self.class_names = [self._lib.loader_class_name(self._handle, i).decode()
+                            for i in range(self._lib.loader_classes(self._handle))]
+        self.samples = self._lib.loader_samples(self._handle)
+
+    def __len__(self):
+        return self._lib.loader_batches_per_epoch(self._handle)
+
+    def next_batch(self):
+        """(images float32 in [0, 1] of shape (n, size, size, 3), labels float32 of shape (n,))
+
+        Images that cannot be decoded are left out of their batch; batches
+        with none left are skipped.
+        """
+        size = self.options.size
+        images = np.empty((self.options.batch_size, size, size, 3), dtype=np.uint8)
+        labels = np.empty(self.options.batch_size, dtype=np.int32)
+        for _ in range(len(self)):
+            count = self._lib.loader_next(self._handle, images.ctypes.data, labels.ctypes.data)
+            if count > 0:
+                return images[:count].astype(np.float32) / 255.0, labels[:count].astype(np.float32)
+        raise RuntimeError('No image of a whole epoch could be decoded')
+
+    def batches(self):
+        while True:
+            yield self.next_batch()
+
+    def close(self):
+        if self._handle:
+            self._lib.loader_close(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
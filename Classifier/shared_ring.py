@@ -0,0 +1,108 @@
+import mmap
+import os
+import struct
+import time
+
+import numpy as np
+
+# Reader for the shared-memory ring written by net1.exe --shm (format in
+# imgproc/shared_ring.h). Linux exposes POSIX shared memory under /dev/shm.
+
+RING_MAGIC = b'IMGRING\0'
+RING_VERSION = 1
+RING_HEADER_BYTES = 128
+SLOT_HEADER_BYTES = 256
+TENSOR_TYPES = {0: np.uint8, 1: np.float32, 2: np.float16, 3: np.uint16}  # 3 is bfloat16
+TENSOR_BFLOAT16 = 3
+
+
+class SharedRingReader:
+    """Iterate over (name, tensor) pairs as the writer publishes them:
+
+        for name, image in SharedRingReader('/imgproc'):
+            ...
+
+    Each tensor is a (height, width, channels) array copied out of the ring,
+    so the slot is handed back to the writer immediately: uint8 images, or
+    float32 / float16 with net1.exe --tensor (bfloat16 arrives as float32).
+    """
+
+    def __init__(self, name, poll=0.0005, timeout=30.0):
+        path = '/dev/shm/' + name.lstrip('/')
+        self._path = path
+        self._poll = poll
+
+        deadline = time.monotonic() + timeout
+        while True:
+            try:
+                fd = os.open(path, os.O_RDWR)
+                size = os.fstat(fd).st_size
+                if size >= RING_HEADER_BYTES:
+                    break
+                os.close(fd)
+            except FileNotFoundError:
+                pass
+            if time.monotonic() > deadline:
+                raise TimeoutError('no ring at ' + path)
+            time.sleep(0.05)
+        self._map = mmap.mmap(fd, size)
+        os.close(fd)
+
+        while bytes(self._map[0:8]) != RING_MAGIC:
+            if time.monotonic() > deadline:
+                raise TimeoutError('ring at ' + path + ' was never initialised')
+            time.sleep(0.001)
+        version, self.slot_count, self.slot_bytes, self._data_offset = struct.unpack_from('<IIQQ', self._map, 8)
+        if version != RING_VERSION:
+            raise ValueError('unsupported ring version %d' % version)
+
+        # 8-byte aligned numpy views give single loads / stores of the counters
+        header = np.ndarray((RING_HEADER_BYTES // 8,), dtype='<u8', buffer=self._map)
+        self._write_sequence = header[4:5]
+        self._read_sequence = header[5:6]
+        self._closed = np.ndarray((1,), dtype='<u4', buffer=self._map, offset=48)
+
+    def _slot_offset(self, sequence):
+        return self._data_offset + (sequence % self.slot_count) * self.slot_bytes
+
+    def read(self):
+        """The next (name, tensor), or None once the writer closed the ring and it is drained."""
+        sequence = int(self._read_sequence[0])
+        offset = self._slot_offset(sequence)
+        slot_sequence = np.ndarray((1,), dtype='<u8', buffer=self._map, offset=offset)
+        while int(slot_sequence[0]) != sequence + 1:
+            if self._closed[0] and int(self._write_sequence[0]) == sequence:
+                return None
+            time.sleep(self._poll)
+
+        width, height, channels, kind, payload_bytes, name_bytes = struct.unpack_from('<IIIIQI', self._map, offset + 8)
+        name = bytes(self._map[offset + 64:offset + 64 + name_bytes]).decode(errors='replace')
+        dtype = np.dtype(TENSOR_TYPES[kind])
+        tensor = np.frombuffer(self._map, dtype=dtype, count=payload_bytes // dtype.itemsize,
+                               offset=offset + SLOT_HEADER_BYTES).reshape(height, width, channels).copy()
+        self._read_sequence[0] = sequence + 1
+        if kind == TENSOR_BFLOAT16:
+            # numpy has no bfloat16: widen to the float32 it is the upper half of
+            tensor = (tensor.astype(np.uint32) << 16).view(np.float32)
+        return name, tensor
+
+    def __iter__(self):
+        while True:
+            item = self.read()
+            if item is None:
+                return
+            yield item
+
+    def close(self, remove=True):
+        """Unmap, and remove the segment once the writer is done with it."""
+        if self._map is None:
+            return
+        finished = bool(self._closed[0])
+        del self._write_sequence, self._read_sequence, self._closed
+        self._map.close()
+        self._map = None
+        if remove and finished:
+            try:
+                os.unlink(self._path)
+            except FileNotFoundError:
+                pass
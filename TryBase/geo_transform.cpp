@@ -1,96 +1,107 @@
 #include <iostream>
 #include <cmath>
+#include <cstring>
 #include <omp.h>
 using namespace std;
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "../stb_image.h"
+#include "../stb_image_write.h"
+#include "../imgproc/geometry.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-
-// Function to apply Rotation on the image
-void applyRotation(unsigned char *img, unsigned char *output, int width, int height, int channels, float angle)
+// Row y of the Rotation: output pixel (x, y) comes from the source pixel it
+// maps to, and is left untouched when that falls outside the image
+void rotateRow(unsigned char *img, unsigned char *output, int width, int height, int channels, float cosA, float sinA, int y)
 {
-    float radians = angle * M_PI / 180.0; // Convert angle to radians
     int centerX = width / 2;
     int centerY = height / 2;
 
-#pragma omp parallel for collapse(2)
-    for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
     {
-        for (int x = 0; x < width; x++)
-        {
-            int newX = (int)((x - centerX) * cos(radians) - (y - centerY) * sin(radians) + centerX);
-            int newY = (int)((x - centerX) * sin(radians) + (y - centerY) * cos(radians) + centerY);
+        int newX = (int)((x - centerX) * cosA - (y - centerY) * sinA + centerX);
+        int newY = (int)((x - centerX) * sinA + (y - centerY) * cosA + centerY);
 
-            if (newX >= 0 && newX < width && newY >= 0 && newY < height)
+        if (newX >= 0 && newX < width && newY >= 0 && newY < height)
+        {
+            for (int c = 0; c < channels; c++)
             {
-                for (int c = 0; c < channels; c++)
-                {
-                    output[(y * width + x) * channels + c] = img[(newY * width + newX) * channels + c];
-                }
+                output[(y * width + x) * channels + c] = img[(newY * width + newX) * channels + c];
             }
         }
     }
 }
 
-// Function to apply Scaling on the image
-void applyScaling(unsigned char *img, unsigned char *output, int width, int height, int channels, float scaleX, float scaleY)
+// Row y of the Scaling
+void scaleRow(unsigned char *img, unsigned char *output, int width, int height, int channels, float scaleX, float scaleY, int y)
 {
-#pragma omp parallel for collapse(2)
-    for (int y = 0; y < height; y++)
+    int newY = (int)(y / scaleY);
+    if (newY < 0 || newY >= height)
+        return;
+
+    for (int x = 0; x < width; x++)
     {
-        for (int x = 0; x < width; x++)
-        {
-            int newX = (int)(x / scaleX);
-            int newY = (int)(y / scaleY);
+        int newX = (int)(x / scaleX);
 
-            if (newX >= 0 && newX < width && newY >= 0 && newY < height)
+        if (newX >= 0 && newX < width)
+        {
+            for (int c = 0; c < channels; c++)
             {
-                for (int c = 0; c < channels; c++)
-                {
-                    output[(y * width + x) * channels + c] = img[(newY * width + newX) * channels + c];
-                }
+                output[(y * width + x) * channels + c] = img[(newY * width + newX) * channels + c];
             }
         }
     }
 }
 
-// Function to apply Horizontal Flip on the image
-void applyHorizontalFlip(unsigned char *img, unsigned char *output, int width, int height, int channels)
+// Function to apply Rotation on the image
+void applyRotation(unsigned char *img, unsigned char *output, int width, int height, int channels, float angle)
 {
-#pragma omp parallel for collapse(2)
+    float radians = angle * M_PI / 180.0; // Convert angle to radians
+
+#pragma omp parallel for
     for (int y = 0; y < height; y++)
     {
-        for (int x = 0; x < width; x++)
-        {
-            for (int c = 0; c < channels; c++)
-            {
-                int oppositeX = width - 1 - x;
-                // Get the original pixel and set it in the opposite location in the output
-                output[(y * width + oppositeX) * channels + c] = img[(y * width + x) * channels + c];
-            }
-        }
+        rotateRow(img, output, width, height, channels, cos(radians), sin(radians), y);
+    }
+}
+
+// Function to apply Scaling on the image
+void applyScaling(unsigned char *img, unsigned char *output, int width, int height, int channels, float scaleX, float scaleY)
+{
+#pragma omp parallel for
+    for (int y = 0; y < height; y++)
+    {
+        scaleRow(img, output, width, height, channels, scaleX, scaleY, y);
     }
 }
 
-// Function to apply Vertical Flip on the image
+// Function to apply Horizontal Flip on the image (SIMD pixel reversal)
+void applyHorizontalFlip(unsigned char *img, unsigned char *output, int width, int height, int channels)
+{
+    apply_flip_horizontal(ImageView(img, width, height, channels), ImageView(output, width, height, channels));
+}
+
+// Function to apply Vertical Flip on the image (one memcpy per row)
 void applyVerticalFlip(unsigned char *img, unsigned char *output, int width, int height, int channels)
 {
-#pragma omp parallel for collapse(2)
+    apply_flip_vertical(ImageView(img, width, height, channels), ImageView(output, width, height, channels));
+}
+
+// All four transforms: rotation and scaling in one traversal, where each
+// thread produces row y of both outputs from the same neighbourhood of the
+// source, then the flips, which are only row copies and shuffles
+void applyAllTransforms(unsigned char *img, unsigned char *outputs[4], int width, int height, int channels,
+                        float angle, float scaleX, float scaleY)
+{
+    float radians = angle * M_PI / 180.0; // Convert angle to radians
+    float cosA = cos(radians), sinA = sin(radians);
+
+#pragma omp parallel for
     for (int y = 0; y < height; y++)
     {
-        for (int x = 0; x < width; x++)
-        {
-            for (int c = 0; c < channels; c++)
-            {
-                int oppositeY = height - 1 - y;
-                // Get the original pixel and set it in the opposite location in the output
-                output[(oppositeY * width + x) * channels + c] = img[(y * width + x) * channels + c];
-            }
-        }
+        rotateRow(img, outputs[0], width, height, channels, cosA, sinA, y);
+        scaleRow(img, outputs[1], width, height, channels, scaleX, scaleY, y);
     }
+    applyHorizontalFlip(img, outputs[2], width, height, channels);
+    applyVerticalFlip(img, outputs[3], width, height, channels);
 }
 
 int main()
@@ -109,24 +120,26 @@ int main()
     unsigned char *imgScaled = new unsigned char[width * height * channels];
     unsigned char *imgHorizontallyFlipped = new unsigned char[width * height * channels];
     unsigned char *imgVerticallyFlipped = new unsigned char[width * height * channels];
-
-    // Apply Rotation (example: 45 degrees)
-    applyRotation(img, imgRotated, width, height, channels, 45);
-
-    // Apply Scaling (example: scale 1.5x in X and 1.5x in Y direction)
-    applyScaling(img, imgScaled, width, height, channels, 1.5, 1.5);
-
-    // Apply Horizontal Flip
-    applyHorizontalFlip(img, imgHorizontallyFlipped, width, height, channels);
-
-    // Apply Vertical Flip
-    applyVerticalFlip(img, imgVerticallyFlipped, width, height, channels);
-
-    // Save the images after transformations
-    stbi_write_jpg("output_rotated.jpg", width, height, channels, imgRotated, 100);
-    stbi_write_jpg("output_scaled.jpg", width, height, channels, imgScaled, 100);
-    stbi_write_jpg("output_horizontal_flip.jpg", width, height, channels, imgHorizontallyFlipped, 100);
-    stbi_write_jpg("output_vertical_flip.jpg", width, height, channels, imgVerticallyFlipped, 100);
+    unsigned char *imgRotated90 = new unsigned char[width * height * channels];
+
+    // Rotation (example: 45 degrees), Scaling (example: scale 1.5x in X and
+    // 1.5x in Y direction), Horizontal Flip and Vertical Flip from one pass
+    unsigned char *outputs[4] = {imgRotated, imgScaled, imgHorizontallyFlipped, imgVerticallyFlipped};
+    applyAllTransforms(img, outputs, width, height, channels, 45, 1.5, 1.5);
+
+    // Exact quarter turn (the output is height x width), as used for augmentation
+    apply_rotation(ImageView(img, width, height, channels), ImageView(imgRotated90, height, width, channels), ROTATE_90);
+
+    // Save the images after transformations, encoding them in parallel
+    const char *outputNames[5] = {"output_rotated.jpg", "output_scaled.jpg", "output_horizontal_flip.jpg", "output_vertical_flip.jpg",
+                                  "output_rotated_90.jpg"};
+    unsigned char *images[5] = {imgRotated, imgScaled, imgHorizontallyFlipped, imgVerticallyFlipped, imgRotated90};
+#pragma omp parallel for
+    for (int i = 0; i < 5; i++)
+    {
+        bool quarterTurn = images[i] == imgRotated90;
+        stbi_write_jpg(outputNames[i], quarterTurn ? height : width, quarterTurn ? width : height, channels, images[i], 100);
+    }
 
     // Free the image memory
     stbi_image_free(img);
@@ -134,6 +147,7 @@ int main()
     delete[] imgScaled;
     delete[] imgHorizontallyFlipped;
     delete[] imgVerticallyFlipped;
+    delete[] imgRotated90;
 
     return 0;
 }
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <cstring>
+#include <string>
+using namespace std;
+
+#include "../stb_image.h"
+#include "../stb_image_write.h"
+#include "../imgproc/pipeline.h"
+
+// Usage: pipeline.exe input.jpg output.jpg "gray,blur:3,sharpen,clahe:8"
+int main(int argc, char **argv)
+{
+    const char *inputPath = argc > 1 ? argv[1] : "cancer_base.jpg";
+    const char *outputPath = argc > 2 ? argv[2] : "output_pipeline.jpg";
+    string spec = argc > 3 ? argv[3] : DEFAULT_PIPELINE;
+
+    Pipeline pipeline;
+    string error;
+    if (!parse_pipeline(spec, pipeline, error))
+    {
+        cout << "Invalid pipeline: " << error << "\n";
+        return -1;
+    }
+    cout << "Pipeline:\n" << pipeline.describe();
+
+    int width, height, channels;
+    unsigned char *img = stbi_load(inputPath, &width, &height, &channels, 0);
+
+    if (img == NULL)
+    {
+        cout << "Error loading image\n";
+        return -1;
+    }
+
+    ImageView result = pipeline.run(ImageView(img, width, height, channels));
+
+    // A crop keeps the row stride of the full image, pack it before writing
+    for (int y = 0; y < result.height; y++)
+    {
+        memmove(img + y * result.row_bytes(), result.row(y), result.row_bytes());
+    }
+    stbi_write_jpg(outputPath, result.width, result.height, channels, img, 100);
+    stbi_image_free(img);
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+using namespace std;
+using namespace chrono;
+
+#include "../stb_image.h"
+#include "../imgproc/cnn.h"
+#include "../imgproc/pipeline.h"
+#include "../imgproc/quantize.h"
+
+// Usage: quantize_eval.exe model.bin [test_dir] [calibration_dir] [calibration_images] [ops]
+//
+// Quantises the exported classifier to INT8, calibrating on images spread
+// evenly over calibration_dir, then scores test_dir (one folder per class,
+// sorted, so benign = 0 and malignant = 1 as with flow_from_directory) with
+// both models. Prints the metrics of Classifier/base.ipynb and try.py for
+// each. With `ops` every image goes through that pipeline first, as for the
+// model trained on the processed dataset.
+
+struct Sample
+{
+    string path;
+    int label;
+};
+
+struct Metrics
+{
+    double accuracy, precision, recall, f1;
+};
+
+// Sorted entries of `path` that are directories (or regular files)
+vector<string> listDirectory(const string &path, bool directories)
+{
+    vector<string> names;
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return names;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        string name = entry->d_name;
+        struct stat info;
+        if (name[0] == '.' || stat((path + "/" + name).c_str(), &info) != 0)
+            continue;
+        if (directories ? S_ISDIR(info.st_mode) : S_ISREG(info.st_mode))
+            names.push_back(name);
+    }
+    closedir(dir);
+    sort(names.begin(), names.end());
+    return names;
+}
+
+vector<Sample> listSamples(const string &root)
+{
+    vector<Sample> samples;
+    vector<string> classes = listDirectory(root, true);
+    for (size_t label = 0; label < classes.size(); label++)
+    {
+        const string folder = root + "/" + classes[label];
+        for (const string &name : listDirectory(folder, false))
+            samples.push_back({folder + "/" + name, static_cast<int>(label)});
+    }
+    return samples;
+}
+
+// Decode, run the optional pipeline and resize into the model input
+bool prepareImage(const Model &model, const Pipeline *pipeline, const string &path, float *input)
+{
+    int width, height, channels;
+    unsigned char *img = stbi_load(path.c_str(), &width, &height, &channels, 0);
+    if (img == NULL)
+        return false;
+    ImageView view(img, width, height, channels);
+    if (pipeline != nullptr)
+        view = pipeline->run(view);
+    prepare_input(model, view, input);
+    stbi_image_free(img);
+    return true;
+}
+
+// Positive class 1 (malignant), predicted when p > 0.5 like np.round
+Metrics computeMetrics(const vector<int> &labels, const vector<float> &scores)
+{
+    int tp = 0, fp = 0, fn = 0, tn = 0;
+    for (size_t i = 0; i < labels.size(); i++)
+    {
+        const bool predicted = scores[i] > 0.5f;
+        if (predicted)
+            (labels[i] == 1 ? tp : fp)++;
+        else
+            (labels[i] == 1 ? fn : tn)++;
+    }
+    Metrics m;
+    m.accuracy = labels.empty() ? 0.0 : static_cast<double>(tp + tn) / labels.size();
+    m.precision = tp + fp > 0 ? static_cast<double>(tp) / (tp + fp) : 0.0;
+    m.recall = tp + fn > 0 ? static_cast<double>(tp) / (tp + fn) : 0.0;
+    m.f1 = m.precision + m.recall > 0 ? 2 * m.precision * m.recall / (m.precision + m.recall) : 0.0;
+    return m;
+}
+
+void printMetrics(const char *name, const Metrics &m, double msPerImage)
+{
+    cout << name << "\n";
+    cout << "  Accuracy: " << m.accuracy << "\n";
+    cout << "  Precision: " << m.precision << "\n";
+    cout << "  Recall: " << m.recall << "\n";
+    cout << "  F1 Score: " << m.f1 << "\n";
+    cout << "  Time: " << msPerImage << " ms per image\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        cout << "Usage: quantize_eval.exe model.bin [test_dir] [calibration_dir] [calibration_images] [ops]\n";
+        return -1;
+    }
+    const string modelPath = argv[1];
+    const string testDir = argc > 2 ? argv[2] : "../melanomaDataset/melanoma_cancer_dataset/test";
+    const string calibrationDir = argc > 3 ? argv[3] : "../melanomaDataset/melanoma_cancer_dataset/train";
+    const int calibrationImages = argc > 4 ? max(atoi(argv[4]), 1) : 200;
+    const string spec = argc > 5 ? argv[5] : "";
+
+    string error;
+    Model model;
+    if (!load_model(modelPath, model, error))
+    {
+        cout << "Error loading model: " << error << "\n";
+        return -1;
+    }
+    Pipeline pipeline;
+    if (!spec.empty() && !parse_pipeline(spec, pipeline, error))
+    {
+        cout << "Invalid pipeline: " << error << "\n";
+        return -1;
+    }
+    const Pipeline *ops = spec.empty() ? nullptr : &pipeline;
+    const size_t inputSize = static_cast<size_t>(model.height) * model.width * model.channels;
+
+    // Calibration sample spread over every class
+    vector<Sample> pool = listSamples(calibrationDir);
+    if (pool.empty())
+    {
+        cout << "No calibration images in " << calibrationDir << "\n";
+        return -1;
+    }
+    const int count = min(calibrationImages, static_cast<int>(pool.size()));
+    vector<float> calibration(inputSize * count);
+    int loaded = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const Sample &sample = pool[static_cast<size_t>(i) * pool.size() / count];
+        if (prepareImage(model, ops, sample.path, &calibration[inputSize * loaded]))
+            loaded++;
+    }
+    Model quantized = model;
+    if (!quantize_model(quantized, calibration.data(), loaded, error))
+    {
+        cout << "Quantisation failed: " << error << "\n";
+        return -1;
+    }
+    cout << "Calibrated on " << loaded << " images of " << calibrationDir << "\n";
+
+    // Score the test set in batches of 16 with both models
+    vector<Sample> tests = listSamples(testDir);
+    const int batchSize = 16;
+    vector<float> batch(inputSize * batchSize), output(batchSize);
+    vector<int> labels;
+    vector<float> floatScores, int8Scores;
+    double floatMs = 0.0, int8Ms = 0.0;
+    Activations buffers;
+    for (size_t first = 0; first < tests.size(); first += batchSize)
+    {
+        int n = 0;
+        for (size_t i = first; i < min(first + batchSize, tests.size()); i++)
+        {
+            if (prepareImage(model, ops, tests[i].path, &batch[inputSize * n]))
+            {
+                labels.push_back(tests[i].label);
+                n++;
+            }
+            else
+            {
+                cout << "Error loading " << tests[i].path << "\n";
+            }
+        }
+        if (n == 0)
+            continue;
+
+        auto start = high_resolution_clock::now();
+        model.forward(batch.data(), n, output.data(), buffers);
+        auto middle = high_resolution_clock::now();
+        floatScores.insert(floatScores.end(), output.begin(), output.begin() + n);
+        quantized.forward(batch.data(), n, output.data(), buffers);
+        auto end = high_resolution_clock::now();
+        int8Scores.insert(int8Scores.end(), output.begin(), output.begin() + n);
+        floatMs += duration<double, milli>(middle - start).count();
+        int8Ms += duration<double, milli>(end - middle).count();
+    }
+    if (labels.empty())
+    {
+        cout << "No test images in " << testDir << "\n";
+        return -1;
+    }
+
+    const int images = static_cast<int>(labels.size());
+    int agree = 0;
+    double maxDiff = 0.0;
+    for (int i = 0; i < images; i++)
+    {
+        agree += (floatScores[i] > 0.5f) == (int8Scores[i] > 0.5f);
+        maxDiff = max(maxDiff, static_cast<double>(fabs(floatScores[i] - int8Scores[i])));
+    }
+    cout << images << " test images\n";
+    printMetrics("Float32", computeMetrics(labels, floatScores), floatMs / images);
+    printMetrics("INT8", computeMetrics(labels, int8Scores), int8Ms / images);
+    cout << "Same prediction: " << 100.0 * agree / images << "%, largest probability difference: " << maxDiff << "\n";
+    return 0;
+}
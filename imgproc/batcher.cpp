@@ -0,0 +1,157 @@
+#include "batcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+struct Batch
+{
+    int reserved = 0; // slots handed to producers
+    int count = 0;    // slots whose input is ready
+    vector<float> input; // max_batch model inputs
+    vector<string> names;
+    vector<steady_clock::time_point> submitted;
+};
+
+struct BatchScheduler
+{
+    const Model &model;
+    BatchOptions options;
+    BatchCallback callback;
+
+    mutex lock;
+    condition_variable filled;  // an image arrived or stopping
+    condition_variable drained; // the batch being filled has room again
+    Batch batches[2];
+    int filling = 0; // index of the batch submit_image writes into
+    bool stopping = false;
+    BatchStats stats;
+
+    // Touched by the scheduler thread only
+    Activations activations;
+    vector<float> output;
+
+    thread worker;
+
+    BatchScheduler(const Model &model, const BatchOptions &options, BatchCallback callback)
+        : model(model), options(options), callback(move(callback))
+    {
+    }
+};
+
+static void run_batch(BatchScheduler *scheduler, Batch &batch)
+{
+    const int outputs = scheduler->model.output_size();
+    scheduler->model.forward(batch.input.data(), batch.count, scheduler->output.data(), scheduler->activations);
+
+    const auto now = steady_clock::now();
+    double max_wait = 0.0;
+    for (int i = 0; i < batch.count; i++)
+    {
+        scheduler->callback(batch.names[i], scheduler->output.data() + static_cast<size_t>(i) * outputs);
+        max_wait = max(max_wait, duration<double, milli>(now - batch.submitted[i]).count());
+    }
+
+    lock_guard<mutex> guard(scheduler->lock);
+    BatchStats &stats = scheduler->stats;
+    stats.images += batch.count;
+    stats.batches++;
+    stats.full_batches += batch.count == scheduler->options.max_batch;
+    stats.max_wait_ms = max(stats.max_wait_ms, max_wait);
+    batch.count = 0;
+    batch.reserved = 0;
+}
+
+static void scheduler_thread(BatchScheduler *scheduler)
+{
+    const auto latency = duration_cast<steady_clock::duration>(duration<double, milli>(scheduler->options.max_latency_ms));
+    unique_lock<mutex> guard(scheduler->lock);
+    for (;;)
+    {
+        Batch &batch = scheduler->batches[scheduler->filling];
+        scheduler->filled.wait(guard, [&] { return batch.reserved > 0 || scheduler->stopping; });
+        if (batch.reserved == 0)
+            break;
+
+        // The deadline runs from the oldest image, so one that arrived while
+        // the previous batch was running may go at once
+        scheduler->filled.wait_until(guard, batch.submitted[0] + latency, [&] {
+            return batch.count == scheduler->options.max_batch || scheduler->stopping;
+        });
+
+        // Producers move to the other buffer, emptied by the previous run;
+        // inputs still being resized into this one are waited for
+        scheduler->filling ^= 1;
+        scheduler->drained.notify_all();
+        scheduler->filled.wait(guard, [&] { return batch.count == batch.reserved; });
+        guard.unlock();
+        run_batch(scheduler, batch);
+        guard.lock();
+    }
+}
+
+BatchScheduler *start_batch_scheduler(const Model &model, const BatchOptions &options, BatchCallback callback)
+{
+    BatchScheduler *scheduler = new BatchScheduler(model, options, move(callback));
+    BatchOptions &o = scheduler->options;
+    o.max_batch = max(o.max_batch, 1);
+    o.max_latency_ms = max(o.max_latency_ms, 0.0);
+
+    const size_t input_size = static_cast<size_t>(model.height) * model.width * model.channels;
+    for (Batch &batch : scheduler->batches)
+    {
+        batch.input.resize(input_size * o.max_batch);
+        batch.names.resize(o.max_batch);
+        batch.submitted.resize(o.max_batch);
+    }
+    scheduler->output.resize(static_cast<size_t>(model.output_size()) * o.max_batch);
+    scheduler->worker = thread(scheduler_thread, scheduler);
+    return scheduler;
+}
+
+void submit_image(BatchScheduler *scheduler, const string &name, const ImageView &img)
+{
+    // Reserve a slot under the lock; the first one starts the deadline
+    unique_lock<mutex> guard(scheduler->lock);
+    scheduler->drained.wait(
+        guard, [&] { return scheduler->batches[scheduler->filling].reserved < scheduler->options.max_batch; });
+    const int index = scheduler->filling;
+    Batch &batch = scheduler->batches[index];
+    const int slot = batch.reserved++;
+    batch.submitted[slot] = steady_clock::now();
+    if (slot == 0)
+        scheduler->filled.notify_one();
+    guard.unlock();
+
+    // Resize straight into the slot without the lock; the scheduler does not
+    // run the batch until every reserved slot is ready
+    const Model &model = scheduler->model;
+    const size_t input_size = static_cast<size_t>(model.height) * model.width * model.channels;
+    prepare_input(model, img, batch.input.data() + slot * input_size);
+    batch.names[slot] = name;
+
+    // The last image fills the batch, or completes one the scheduler already took
+    guard.lock();
+    batch.count++;
+    if (batch.count == scheduler->options.max_batch || (index != scheduler->filling && batch.count == batch.reserved))
+        scheduler->filled.notify_one();
+}
+
+void stop_batch_scheduler(BatchScheduler *scheduler, BatchStats *stats)
+{
+    {
+        lock_guard<mutex> guard(scheduler->lock);
+        scheduler->stopping = true;
+    }
+    scheduler->filled.notify_one();
+    scheduler->worker.join();
+    if (stats != nullptr)
+        *stats = scheduler->stats;
+    delete scheduler;
+}
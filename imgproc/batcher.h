@@ -0,0 +1,45 @@
+#ifndef IMGPROC_BATCHER_H
+#define IMGPROC_BATCHER_H
+
+#include "cnn.h"
+#include "image_view.h"
+
+#include <functional>
+#include <string>
+
+// Micro-batching in front of Model::forward. Images submitted by the
+// preprocessing loop are resized straight into the batch being filled; a
+// scheduler thread runs the batch once it holds max_batch images or its
+// oldest image has waited max_latency_ms, so dense layers become GEMMs over
+// the batch and the weights are read once per batch instead of per image.
+// Two batch buffers alternate: one fills while the other runs.
+
+struct BatchOptions
+{
+    int max_batch = 8;
+    double max_latency_ms = 50.0;
+};
+
+struct BatchStats
+{
+    long long images = 0;
+    long long batches = 0;
+    long long full_batches = 0;  // dispatched because max_batch was reached
+    double max_wait_ms = 0.0;    // longest submit-to-result time
+};
+
+// Called on the scheduler thread, in submission order, with the image name
+// and its model output (output_size() values)
+typedef std::function<void(const std::string &name, const float *output)> BatchCallback;
+
+struct BatchScheduler;
+
+BatchScheduler *start_batch_scheduler(const Model &model, const BatchOptions &options, BatchCallback callback);
+
+// Queue one image, waiting while both batch buffers are busy
+void submit_image(BatchScheduler *scheduler, const std::string &name, const ImageView &img);
+
+// Run what is still queued, stop the thread and free the scheduler
+void stop_batch_scheduler(BatchScheduler *scheduler, BatchStats *stats = nullptr);
+
+#endif
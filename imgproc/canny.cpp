@@ -0,0 +1,185 @@
+#include "kernels.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// Hysteresis labels
+static const unsigned char NOT_EDGE = 0;
+static const unsigned char WEAK = 1;
+static const unsigned char STRONG = 2;
+
+// Offsets of the two neighbours along each SobelDirection
+static const int NEIGHBOUR_DX[4] = {1, 1, 0, 1};
+static const int NEIGHBOUR_DY[4] = {0, 1, 1, -1};
+
+// Non-maximum suppression of one row. `magnitude` has a zero border, so the
+// neighbours are plain offsets. Ties on saturated ridges keep the pixel on
+// one side only (> against one neighbour, >= against the other) so edges
+// stay one pixel wide.
+static void suppress_row(const unsigned char *magnitude, int stride, const unsigned char *direction, int width, int low,
+                         int high, unsigned char *label)
+{
+    int offset[4];
+    for (int k = 0; k < 4; k++)
+        offset[k] = NEIGHBOUR_DY[k] * stride + NEIGHBOUR_DX[k];
+
+    for (int x = 0; x < width; x++)
+    {
+        const int value = magnitude[x];
+        if (value < low)
+            continue;
+        const int o = offset[direction[x]];
+        if (value > magnitude[x + o] && value >= magnitude[x - o])
+            label[x] = value >= high ? STRONG : WEAK;
+    }
+}
+
+// Strong labels as 255 in a plane or in every colour channel, alpha copied
+static void write_edges(const unsigned char *label, const unsigned char *in, int c, unsigned char *out, int out_c, int width)
+{
+    const int cc = (out_c == 2 || out_c == 4) ? out_c - 1 : out_c;
+    for (int x = 0; x < width; x++)
+    {
+        const unsigned char edge = label[x] == STRONG ? 255 : 0;
+        for (int ch = 0; ch < cc; ch++)
+            out[x * out_c + ch] = edge;
+        if (cc != out_c)
+            out[x * out_c + cc] = in[x * c + cc];
+    }
+}
+
+// Promote every weak pixel 8-connected to the pixels on `stack` to strong,
+// staying within rows [y0, y1). `labels` has a one pixel border of NOT_EDGE.
+static void flood_strong(unsigned char *labels, int stride, int y0, int y1, vector<int> &stack)
+{
+    while (!stack.empty())
+    {
+        const int index = stack.back();
+        stack.pop_back();
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            const int y = index / stride + dy;
+            if (y < y0 || y >= y1)
+                continue;
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                const int neighbour = index + dy * stride + dx;
+                if (labels[neighbour] == WEAK)
+                {
+                    labels[neighbour] = STRONG;
+                    stack.push_back(neighbour);
+                }
+            }
+        }
+    }
+}
+
+void apply_canny(const ImageView &src, const ImageView &dst, int low, int high)
+{
+    const int width = src.width;
+    const int height = src.height;
+    const int c = src.channels;
+
+    // Gray plane, smoothed with the 5x5 Gaussian (sigma 1)
+    vector<unsigned char> gray(static_cast<size_t>(width) * height);
+    vector<unsigned char> blurred(gray.size());
+    const ImageView gray_view(gray.data(), width, height, 1);
+    const ImageView blurred_view(blurred.data(), width, height, 1);
+    apply_grayscale(src, gray_view);
+    apply_gaussian_blur(gray_view, blurred_view, 2, 1.0f);
+
+    // Gradient magnitude (clipped to 255) with a zero border, and direction
+    PaddedImage magnitude(width, height, 1, 1);
+    vector<unsigned char> direction(gray.size());
+    apply_sobel(blurred_view, magnitude.view(), SOBEL_L2, false, ImageView(direction.data(), width, height, 1));
+
+    // Non-maximum suppression into labels with a one pixel border, so the
+    // hysteresis needs no bounds checks either
+    const int stride = width + 2;
+    vector<unsigned char> labels(static_cast<size_t>(stride) * (height + 2), NOT_EDGE);
+    unsigned char *label = labels.data() + stride + 1;
+#pragma omp parallel for
+    for (int y = 0; y < height; y++)
+    {
+        suppress_row(magnitude.view().row(y), magnitude.view().stride, direction.data() + static_cast<size_t>(y) * width,
+                     width, low, high, label + y * stride);
+    }
+
+    // Hysteresis in strips: flood from the strong pixels inside each strip,
+    // then repeatedly seed strips from strong pixels their neighbours reached
+    // across the shared boundary rows until nothing changes
+    const int strips = max(1, min(omp_get_max_threads() * 4, height / 16));
+    auto strip_begin = [&](int s) { return s * height / strips; };
+#pragma omp parallel for
+    for (int s = 0; s < strips; s++)
+    {
+        const int y0 = strip_begin(s), y1 = strip_begin(s + 1);
+        vector<int> stack;
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                if (label[y * stride + x] == STRONG)
+                {
+                    stack.push_back(y * stride + x);
+                    flood_strong(label, stride, y0, y1, stack);
+                }
+            }
+        }
+    }
+
+    vector<vector<int>> seeds(strips);
+    bool changed = strips > 1;
+    while (changed)
+    {
+        // Read-only pass: weak pixels on a strip's edge rows touching a strong
+        // pixel in the neighbouring strip
+#pragma omp parallel for
+        for (int s = 0; s < strips; s++)
+        {
+            const int y0 = strip_begin(s), y1 = strip_begin(s + 1);
+            seeds[s].clear();
+            const int edge_rows[2] = {y0, y1 - 1};
+            const int outside[2] = {y0 - 1, y1};
+            for (int e = 0; e < 2; e++)
+            {
+                if (outside[e] < 0 || outside[e] >= height)
+                    continue;
+                const unsigned char *row = label + edge_rows[e] * stride;
+                const unsigned char *across = label + outside[e] * stride;
+                for (int x = 0; x < width; x++)
+                {
+                    if (row[x] == WEAK && (across[x - 1] == STRONG || across[x] == STRONG || across[x + 1] == STRONG))
+                        seeds[s].push_back(edge_rows[e] * stride + x);
+                }
+            }
+        }
+
+        changed = false;
+#pragma omp parallel for reduction(|| : changed)
+        for (int s = 0; s < strips; s++)
+        {
+            if (seeds[s].empty())
+                continue;
+            changed = true;
+            for (int index : seeds[s])
+                label[index] = STRONG;
+            flood_strong(label, stride, strip_begin(s), strip_begin(s + 1), seeds[s]);
+        }
+    }
+
+#pragma omp parallel for
+    for (int y = 0; y < height; y++)
+    {
+        write_edges(label + y * stride, src.row(y), c, dst.row(y), dst.channels, width);
+    }
+}
+
+void apply_canny(const ImageView &img, int low, int high)
+{
+    apply_canny(img, img, low, high);
+}
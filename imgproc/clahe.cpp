@@ -0,0 +1,126 @@
+#include "kernels.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// Number of channels that carry colour, i.e. excluding a trailing alpha channel
+static inline int colour_channels(int channels)
+{
+    return (channels == 2 || channels == 4) ? channels - 1 : channels;
+}
+
+// Tile index and weight of the lower neighbour for each coordinate along one axis
+static void interpolation_axis(int size, int tiles, vector<int> &first, vector<float> &weight)
+{
+    first.resize(size);
+    weight.resize(size);
+    const float tile_size = static_cast<float>(size) / tiles;
+    for (int i = 0; i < size; i++)
+    {
+        float position = (i + 0.5f) / tile_size - 0.5f;
+        int t = static_cast<int>(floor(position));
+        float w = 1.0f - (position - t);
+        if (t < 0)
+        {
+            t = 0;
+            w = 1.0f;
+        }
+        else if (t >= tiles - 1)
+        {
+            t = tiles - 1;
+            w = 1.0f;
+        }
+        first[i] = t;
+        weight[i] = w;
+    }
+}
+
+void apply_clahe(const ImageView &img, int tiles, float clip_limit)
+{
+    const int c = img.channels;
+    const int cc = colour_channels(c);
+    tiles = max(1, min(tiles, min(img.width, img.height)));
+
+    // Per-tile histogram, clipped and redistributed, turned into a mapping
+    vector<unsigned char> luts(static_cast<size_t>(tiles) * tiles * 256);
+#pragma omp parallel for collapse(2)
+    for (int ty = 0; ty < tiles; ty++)
+    {
+        for (int tx = 0; tx < tiles; tx++)
+        {
+            const int x0 = tx * img.width / tiles, x1 = (tx + 1) * img.width / tiles;
+            const int y0 = ty * img.height / tiles, y1 = (ty + 1) * img.height / tiles;
+            int histogram[256] = {0};
+            for (int y = y0; y < y1; y++)
+            {
+                const unsigned char *p = img.pixel(x0, y);
+                for (int x = x0; x < x1; x++, p += c)
+                {
+                    for (int ch = 0; ch < cc; ch++)
+                        histogram[p[ch]]++;
+                }
+            }
+
+            const int samples = (x1 - x0) * (y1 - y0) * cc;
+            const int limit = max(1, static_cast<int>(clip_limit * samples / 256));
+            int excess = 0;
+            for (int i = 0; i < 256; i++)
+            {
+                if (histogram[i] > limit)
+                {
+                    excess += histogram[i] - limit;
+                    histogram[i] = limit;
+                }
+            }
+            const int share = excess / 256;
+            const int remainder = excess % 256;
+            for (int i = 0; i < 256; i++)
+            {
+                histogram[i] += share + (i < remainder ? 1 : 0);
+            }
+
+            unsigned char *lut = &luts[(static_cast<size_t>(ty) * tiles + tx) * 256];
+            const float scale = 255.0f / max(samples, 1);
+            int cumulative = 0;
+            for (int i = 0; i < 256; i++)
+            {
+                cumulative += histogram[i];
+                lut[i] = static_cast<unsigned char>(min(255, static_cast<int>(cumulative * scale + 0.5f)));
+            }
+        }
+    }
+
+    // Bilinear blend of the four surrounding tile mappings
+    vector<int> tile_x, tile_y;
+    vector<float> weight_x, weight_y;
+    interpolation_axis(img.width, tiles, tile_x, weight_x);
+    interpolation_axis(img.height, tiles, tile_y, weight_y);
+
+#pragma omp parallel for
+    for (int y = 0; y < img.height; y++)
+    {
+        const int ty0 = tile_y[y], ty1 = min(ty0 + 1, tiles - 1);
+        const float wy = weight_y[y];
+        unsigned char *p = img.row(y);
+        for (int x = 0; x < img.width; x++, p += c)
+        {
+            const int tx0 = tile_x[x], tx1 = min(tx0 + 1, tiles - 1);
+            const float wx = weight_x[x];
+            const unsigned char *l00 = &luts[(static_cast<size_t>(ty0) * tiles + tx0) * 256];
+            const unsigned char *l01 = &luts[(static_cast<size_t>(ty0) * tiles + tx1) * 256];
+            const unsigned char *l10 = &luts[(static_cast<size_t>(ty1) * tiles + tx0) * 256];
+            const unsigned char *l11 = &luts[(static_cast<size_t>(ty1) * tiles + tx1) * 256];
+            for (int ch = 0; ch < cc; ch++)
+            {
+                const int v = p[ch];
+                float top = wx * l00[v] + (1.0f - wx) * l01[v];
+                float bottom = wx * l10[v] + (1.0f - wx) * l11[v];
+                p[ch] = static_cast<unsigned char>(wy * top + (1.0f - wy) * bottom + 0.5f);
+            }
+        }
+    }
+}
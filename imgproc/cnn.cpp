@@ -0,0 +1,429 @@
+#include "cnn.h"
+#include "quantize.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Columns of C per panel of the GEMM micro-kernel
+static const int PANEL = 16;
+
+// Rows [0, ROWS) x columns [n0, n0 + 16) of C = A B + bias, ReLU optional.
+// Without bias the product is added to C (a later slice of K).
+template <int ROWS>
+static void gemm_block(const float *A, int lda, const float *B, int ldb, float *C, int ldc, int K, int n0,
+                       const float *bias, bool relu)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc[ROWS][2];
+    for (int r = 0; r < ROWS; r++)
+    {
+        acc[r][0] = _mm256_loadu_ps(bias != nullptr ? bias + n0 : C + r * ldc + n0);
+        acc[r][1] = _mm256_loadu_ps(bias != nullptr ? bias + n0 + 8 : C + r * ldc + n0 + 8);
+    }
+    const float *b = B + n0;
+    for (int k = 0; k < K; k++, b += ldb)
+    {
+        const __m256 b0 = _mm256_loadu_ps(b), b1 = _mm256_loadu_ps(b + 8);
+        for (int r = 0; r < ROWS; r++)
+        {
+            const __m256 a = _mm256_broadcast_ss(A + r * lda + k);
+            acc[r][0] = _mm256_fmadd_ps(a, b0, acc[r][0]);
+            acc[r][1] = _mm256_fmadd_ps(a, b1, acc[r][1]);
+        }
+    }
+    const __m256 zero = _mm256_setzero_ps();
+    for (int r = 0; r < ROWS; r++)
+    {
+        if (relu)
+        {
+            acc[r][0] = _mm256_max_ps(acc[r][0], zero);
+            acc[r][1] = _mm256_max_ps(acc[r][1], zero);
+        }
+        _mm256_storeu_ps(C + r * ldc + n0, acc[r][0]);
+        _mm256_storeu_ps(C + r * ldc + n0 + 8, acc[r][1]);
+    }
+#else
+    for (int r = 0; r < ROWS; r++)
+    {
+        float acc[PANEL];
+        for (int j = 0; j < PANEL; j++)
+            acc[j] = bias != nullptr ? bias[n0 + j] : C[r * ldc + n0 + j];
+        for (int k = 0; k < K; k++)
+        {
+            const float a = A[r * lda + k];
+            const float *b = B + static_cast<size_t>(k) * ldb + n0;
+            for (int j = 0; j < PANEL; j++)
+                acc[j] += a * b[j];
+        }
+        for (int j = 0; j < PANEL; j++)
+            C[r * ldc + n0 + j] = relu ? max(acc[j], 0.0f) : acc[j];
+    }
+#endif
+}
+
+// C[M][n0..n1) = A[M][K] B[K][n0..n1) + bias, single-threaded. Six rows by
+// sixteen columns at a time keep twelve accumulators in registers while a
+// K x 16 panel of B is streamed from cache.
+static void gemm(const float *A, int lda, const float *B, int ldb, float *C, int ldc, int M, int n0, int n1, int K,
+                 const float *bias, bool relu)
+{
+    int n = n0;
+    for (; n + PANEL <= n1; n += PANEL)
+    {
+        int m = 0;
+        for (; m + 6 <= M; m += 6)
+            gemm_block<6>(A + static_cast<size_t>(m) * lda, lda, B, ldb, C + static_cast<size_t>(m) * ldc, ldc, K, n, bias, relu);
+        const float *a = A + static_cast<size_t>(m) * lda;
+        float *c = C + static_cast<size_t>(m) * ldc;
+        switch (M - m)
+        {
+        case 5:
+            gemm_block<5>(a, lda, B, ldb, c, ldc, K, n, bias, relu);
+            break;
+        case 4:
+            gemm_block<4>(a, lda, B, ldb, c, ldc, K, n, bias, relu);
+            break;
+        case 3:
+            gemm_block<3>(a, lda, B, ldb, c, ldc, K, n, bias, relu);
+            break;
+        case 2:
+            gemm_block<2>(a, lda, B, ldb, c, ldc, K, n, bias, relu);
+            break;
+        case 1:
+            gemm_block<1>(a, lda, B, ldb, c, ldc, K, n, bias, relu);
+            break;
+        }
+    }
+
+    // Columns left over (the single sigmoid unit)
+    for (; n < n1; n++)
+    {
+        for (int m = 0; m < M; m++)
+        {
+            const float *a = A + static_cast<size_t>(m) * lda;
+            float sum = bias != nullptr ? bias[n] : C[static_cast<size_t>(m) * ldc + n];
+            for (int k = 0; k < K; k++)
+                sum += a[k] * B[static_cast<size_t>(k) * ldb + n];
+            C[static_cast<size_t>(m) * ldc + n] = relu ? max(sum, 0.0f) : sum;
+        }
+    }
+}
+
+Shape output_shape(const Layer &layer, Shape in)
+{
+    switch (layer.type)
+    {
+    case LAYER_CONV2D:
+        return {in.height - layer.kernel_height + 1, in.width - layer.kernel_width + 1, layer.outputs};
+    case LAYER_MAXPOOL:
+        return {in.height / layer.kernel_height, in.width / layer.kernel_width, in.channels};
+    case LAYER_FLATTEN:
+        return {1, 1, static_cast<int>(in.size())};
+    case LAYER_DENSE:
+        return {1, 1, layer.outputs};
+    }
+    return in;
+}
+
+// Valid convolution, one output row of one image per iteration: the row's
+// patches (kernel rows are contiguous in HWC) are gathered into a K-wide
+// matrix and multiplied by the HWIO kernel, which is already K x outputs
+static void conv2d(const Layer &layer, const float *in, Shape s, float *out, Shape o, int batch)
+{
+    const int kw = layer.kernel_width, kh = layer.kernel_height;
+    const int K = kh * kw * s.channels;
+    const int span = kw * s.channels;
+    const bool relu = layer.activation == ACTIVATION_RELU;
+#pragma omp parallel
+    {
+        vector<float> patches(static_cast<size_t>(o.width) * K);
+#pragma omp for schedule(dynamic)
+        for (int r = 0; r < batch * o.height; r++)
+        {
+            const int b = r / o.height, y = r % o.height;
+            const float *image = in + b * s.size();
+            for (int x = 0; x < o.width; x++)
+            {
+                for (int ky = 0; ky < kh; ky++)
+                {
+                    const float *src = image + (static_cast<size_t>(y + ky) * s.width + x) * s.channels;
+                    memcpy(&patches[static_cast<size_t>(x) * K + ky * span], src, span * sizeof(float));
+                }
+            }
+            float *row = out + b * o.size() + static_cast<size_t>(y) * o.width * o.channels;
+            gemm(patches.data(), K, layer.weights.data(), o.channels, row, o.channels, o.width, 0, o.channels, K,
+                 layer.bias.data(), relu);
+        }
+    }
+}
+
+static void maxpool(const Layer &layer, const float *in, Shape s, float *out, Shape o, int batch)
+{
+    const int c = s.channels;
+#pragma omp parallel for
+    for (int r = 0; r < batch * o.height; r++)
+    {
+        const int b = r / o.height, y = r % o.height;
+        const float *image = in + b * s.size();
+        float *dst = out + b * o.size() + static_cast<size_t>(y) * o.width * c;
+        for (int x = 0; x < o.width; x++, dst += c)
+        {
+            const float *first = image + (static_cast<size_t>(y * layer.kernel_height) * s.width + x * layer.kernel_width) * c;
+            memcpy(dst, first, c * sizeof(float));
+            for (int py = 0; py < layer.kernel_height; py++)
+            {
+                for (int px = 0; px < layer.kernel_width; px++)
+                {
+                    const float *p = first + (static_cast<size_t>(py) * s.width + px) * c;
+                    for (int ch = 0; ch < c; ch++)
+                        dst[ch] = max(dst[ch], p[ch]);
+                }
+            }
+        }
+    }
+}
+
+// Rows of K per slice of a dense panel: 2048 x 16 floats (128 KB) stay in L2
+// while every six-row block of the batch goes over them
+static const int DENSE_SLICE = 2048;
+
+// Dense weights regrouped as [outputs / 16][inputs][16], zero padded, so each
+// panel the micro-kernel streams is contiguous instead of a 64-byte read
+// every `outputs` floats
+static void pack_panels(Layer &layer)
+{
+    const int panels = (layer.outputs + PANEL - 1) / PANEL;
+    vector<float> packed(static_cast<size_t>(panels) * layer.inputs * PANEL, 0.0f);
+    for (int k = 0; k < layer.inputs; k++)
+    {
+        for (int n = 0; n < layer.outputs; n++)
+        {
+            packed[(static_cast<size_t>(n / PANEL) * layer.inputs + k) * PANEL + n % PANEL] =
+                layer.weights[static_cast<size_t>(k) * layer.outputs + n];
+        }
+    }
+    layer.weights.swap(packed);
+}
+
+// Every row of the batch times the packed kernel. The threads take 16-column
+// panels, and each panel is read in L2-sized slices of K, so the weights (the
+// bulk of the model) come from memory once per batch rather than once per
+// image.
+static void dense(const Layer &layer, const float *in, float *out, int batch)
+{
+    const bool relu = layer.activation == ACTIVATION_RELU;
+    const int panels = (layer.outputs + PANEL - 1) / PANEL;
+#pragma omp parallel for schedule(dynamic)
+    for (int p = 0; p < panels; p++)
+    {
+        const int n0 = p * PANEL, n1 = min(n0 + PANEL, layer.outputs);
+        const float *panel = layer.weights.data() + static_cast<size_t>(p) * layer.inputs * PANEL;
+        for (int k0 = 0; k0 < layer.inputs; k0 += DENSE_SLICE)
+        {
+            const int k1 = min(k0 + DENSE_SLICE, layer.inputs);
+            gemm(in + k0, layer.inputs, panel + static_cast<size_t>(k0) * PANEL, PANEL, out + n0, layer.outputs, batch, 0,
+                 n1 - n0, k1 - k0, k0 == 0 ? layer.bias.data() + n0 : nullptr, relu && k1 == layer.inputs);
+        }
+    }
+    if (layer.activation == ACTIVATION_SIGMOID)
+    {
+        for (int i = 0; i < batch * layer.outputs; i++)
+            out[i] = 1.0f / (1.0f + exp(-out[i]));
+    }
+}
+
+int Model::output_size() const
+{
+    Shape shape = {height, width, channels};
+    for (const Layer &layer : layers)
+        shape = output_shape(layer, shape);
+    return static_cast<int>(shape.size());
+}
+
+void Model::forward(const float *input, int batch, float *output) const
+{
+    Activations buffers;
+    forward(input, batch, output, buffers);
+}
+
+void Model::forward(const float *input, int batch, float *output, Activations &buffers, float *layer_max) const
+{
+    if (quantized)
+    {
+        forward_int8(*this, input, batch, output, buffers);
+        return;
+    }
+
+    vector<float> &a = buffers.a, &b = buffers.b;
+    const float *in = input;
+    Shape shape = {height, width, channels};
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const Layer &layer = layers[i];
+        const Shape next = output_shape(layer, shape);
+        float *out = output;
+        if (i + 1 < layers.size())
+        {
+            vector<float> &buffer = in == a.data() ? b : a;
+            buffer.resize(next.size() * batch);
+            out = buffer.data();
+        }
+
+        switch (layer.type)
+        {
+        case LAYER_CONV2D:
+            conv2d(layer, in, shape, out, next, batch);
+            break;
+        case LAYER_MAXPOOL:
+            maxpool(layer, in, shape, out, next, batch);
+            break;
+        case LAYER_FLATTEN:
+            memcpy(out, in, shape.size() * batch * sizeof(float));
+            break;
+        case LAYER_DENSE:
+            dense(layer, in, out, batch);
+            break;
+        }
+        if (layer_max != nullptr)
+        {
+            float *end = out + next.size() * batch;
+            layer_max[i] = max(layer_max[i], *max_element(out, end));
+        }
+        in = out;
+        shape = next;
+    }
+}
+
+static bool read_u32(ifstream &file, uint32_t &value)
+{
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+static bool read_floats(ifstream &file, vector<float> &values, size_t count)
+{
+    values.resize(count);
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(values.data()), count * sizeof(float)));
+}
+
+bool load_model(const string &path, Model &model, string &error)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version, height, width, channels, count;
+    if (!file.read(magic, 4) || memcmp(magic, "CNNW", 4) != 0 || !read_u32(file, version) || version != 1)
+    {
+        error = path + " is not a version 1 CNNW weight file";
+        return false;
+    }
+    if (!read_u32(file, height) || !read_u32(file, width) || !read_u32(file, channels) || !read_u32(file, count))
+    {
+        error = path + ": truncated header";
+        return false;
+    }
+    model = Model();
+    model.height = static_cast<int>(height);
+    model.width = static_cast<int>(width);
+    model.channels = static_cast<int>(channels);
+
+    Shape shape = {model.height, model.width, model.channels};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t type, activation, p[4];
+        if (!read_u32(file, type) || !read_u32(file, activation) || !read_u32(file, p[0]) || !read_u32(file, p[1]) ||
+            !read_u32(file, p[2]) || !read_u32(file, p[3]))
+        {
+            error = path + ": truncated layer " + to_string(i);
+            return false;
+        }
+
+        Layer layer{};
+        layer.type = static_cast<LayerType>(type);
+        layer.activation = static_cast<Activation>(activation);
+        bool ok = activation <= ACTIVATION_SIGMOID;
+        switch (type)
+        {
+        case LAYER_CONV2D:
+            layer.kernel_height = static_cast<int>(p[0]);
+            layer.kernel_width = static_cast<int>(p[1]);
+            layer.inputs = static_cast<int>(p[2]);
+            layer.outputs = static_cast<int>(p[3]);
+            ok = ok && activation != ACTIVATION_SIGMOID && layer.inputs == shape.channels &&
+                 layer.kernel_height <= shape.height && layer.kernel_width <= shape.width &&
+                 read_floats(file, layer.weights, static_cast<size_t>(p[0]) * p[1] * p[2] * p[3]) &&
+                 read_floats(file, layer.bias, p[3]);
+            break;
+        case LAYER_MAXPOOL:
+            layer.kernel_height = static_cast<int>(p[0]);
+            layer.kernel_width = static_cast<int>(p[1]);
+            ok = ok && p[0] >= 1 && p[1] >= 1;
+            break;
+        case LAYER_FLATTEN:
+            break;
+        case LAYER_DENSE:
+            layer.inputs = static_cast<int>(p[0]);
+            layer.outputs = static_cast<int>(p[1]);
+            ok = ok && shape.height == 1 && shape.width == 1 && layer.inputs == shape.channels &&
+                 read_floats(file, layer.weights, static_cast<size_t>(p[0]) * p[1]) && read_floats(file, layer.bias, p[1]);
+            if (ok)
+                pack_panels(layer);
+            break;
+        default:
+            ok = false;
+            break;
+        }
+        if (!ok)
+        {
+            error = path + ": bad or truncated layer " + to_string(i);
+            return false;
+        }
+        shape = output_shape(layer, shape);
+        model.layers.push_back(move(layer));
+    }
+    return true;
+}
+
+void prepare_input(const Model &model, const ImageView &img, float *input)
+{
+    const int c = model.channels;
+#pragma omp parallel for
+    for (int y = 0; y < model.height; y++)
+    {
+        const int sy = min(static_cast<int>((y + 0.5f) * img.height / model.height), img.height - 1);
+        float *out = input + static_cast<size_t>(y) * model.width * c;
+        for (int x = 0; x < model.width; x++, out += c)
+        {
+            const int sx = min(static_cast<int>((x + 0.5f) * img.width / model.width), img.width - 1);
+            const unsigned char *p = img.pixel(sx, sy);
+            for (int ch = 0; ch < c; ch++)
+            {
+                // Gray (and gray + alpha) feeds every model channel
+                const int from = img.channels >= 3 ? min(ch, img.channels - 1) : 0;
+                out[ch] = p[from] * (1.0f / 255.0f);
+            }
+        }
+    }
+}
+
+float classify_image(const Model &model, const ImageView &img)
+{
+    vector<float> input(static_cast<size_t>(model.height) * model.width * model.channels);
+    prepare_input(model, img, input.data());
+    vector<float> output(model.output_size());
+    model.forward(input.data(), 1, output.data());
+    return output[0];
+}
@@ -0,0 +1,107 @@
+#ifndef IMGPROC_CNN_H
+#define IMGPROC_CNN_H
+
+#include "image_view.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU inference for the Keras Sequential classifier of Classifier/base.ipynb
+// (Conv2D 32 / 64 / 128 with 2x2 max pooling, then Dense 128, 128, 1).
+//
+// Weight file, written by Classifier/export_weights.py, little-endian:
+//
+//     char     magic[4]       "CNNW"
+//     uint32   version        1
+//     uint32   height, width, channels of the input
+//     uint32   layer count
+//     per layer:
+//         uint32   type, activation        (LayerType, Activation)
+//         uint32   p0, p1, p2, p3
+//         conv2d:  p0 x p1 kernel, p2 -> p3 channels, stride 1, valid padding;
+//                  float32 kernel[p0][p1][p2][p3] (Keras HWIO), float32 bias[p3]
+//         maxpool: p0 x p1 window and stride
+//         flatten: -
+//         dense:   p0 -> p1 units; float32 kernel[p0][p1], float32 bias[p1]
+//
+// Activations are float32 in HWC order, so Flatten is free and matches Keras.
+
+enum LayerType : uint32_t
+{
+    LAYER_CONV2D = 1,
+    LAYER_MAXPOOL = 2,
+    LAYER_FLATTEN = 3,
+    LAYER_DENSE = 4
+};
+
+enum Activation : uint32_t
+{
+    ACTIVATION_NONE = 0,
+    ACTIVATION_RELU = 1,
+    ACTIVATION_SIGMOID = 2
+};
+
+struct Layer
+{
+    LayerType type;
+    Activation activation;
+    int kernel_height, kernel_width; // conv2d kernel, maxpool window
+    int inputs, outputs;             // conv2d channels, dense units
+    std::vector<float> weights;      // conv2d HWIO, dense [outputs / 16][inputs][16] panels
+    std::vector<float> bias;
+
+    // Set by quantize_model (quantize.h) for conv2d and dense
+    std::vector<int8_t> qweights; // [outputs / 16][depth / 4][16][4], depth = inputs rounded up to 4
+    std::vector<float> qscales;   // per output: input step * weight step
+    float output_step = 0.0f;     // step of the uint8 output, 0 for a float output
+};
+
+// Shape of the activations between layers
+struct Shape
+{
+    int height, width, channels;
+    size_t size() const { return static_cast<size_t>(height) * width * channels; }
+};
+
+Shape output_shape(const Layer &layer, Shape in);
+
+// Intermediate activations, kept by callers that run many batches so the
+// buffers are not reallocated (and page-faulted in) on every call
+struct Activations
+{
+    std::vector<float> a, b;
+    std::vector<uint8_t> qa, qb; // quantized models
+};
+
+struct Model
+{
+    int height = 0, width = 0, channels = 0; // input shape
+    std::vector<Layer> layers;
+    bool quantized = false; // forward runs the INT8 kernels of quantize.h
+    float input_step = 0.0f;
+
+    // Size of the final output (1 for the sigmoid classifier)
+    int output_size() const;
+
+    // Run `batch` HWC float images stored one after the other; writes
+    // batch * output_size() values. Convolutions are im2col per output row
+    // plus a blocked AVX2 / FMA GEMM with bias and ReLU in its epilogue;
+    // output rows, and dense output panels, are spread over OpenMP threads.
+    void forward(const float *input, int batch, float *output) const;
+    // With `layer_max` (float models only), layer_max[i] is raised to the
+    // largest value layer i outputs, for calibration
+    void forward(const float *input, int batch, float *output, Activations &buffers, float *layer_max = nullptr) const;
+};
+
+bool load_model(const std::string &path, Model &model, std::string &error);
+
+// Resize `img` to the model input (nearest neighbour, as Keras' load_img
+// with target_size) and rescale to [0, 1]. Gray or RGBA images are expanded
+// or reduced to the model's channels.
+void prepare_input(const Model &model, const ImageView &img, float *input);
+
+// Probability of the positive class (the sigmoid output) for one image
+float classify_image(const Model &model, const ImageView &img);
+
+#endif
@@ -0,0 +1,214 @@
+#include "decode.h"
+#include "../stb_image.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+const char *decode_status_name(DecodeStatus status)
+{
+    switch (status)
+    {
+    case DECODE_OK:
+        return "ok";
+    case DECODE_UNREADABLE:
+        return "unreadable";
+    case DECODE_CORRUPT:
+        return "corrupt";
+    case DECODE_CRASHED:
+        return "crashed";
+    case DECODE_TIMED_OUT:
+        return "timed-out";
+    }
+    return "unknown";
+}
+
+unsigned char *decode_image(const char *path, int &width, int &height, int &channels, DecodeStatus &status,
+                            const char *&reason)
+{
+    unsigned char *img = stbi_load(path, &width, &height, &channels, 0);
+    if (img != NULL)
+    {
+        status = DECODE_OK;
+        return img;
+    }
+    reason = stbi_failure_reason();
+    status = strcmp(reason, "can't fopen") == 0 ? DECODE_UNREADABLE : DECODE_CORRUPT;
+    return nullptr;
+}
+
+unsigned char *decode_image_from_memory(const unsigned char *data, size_t bytes, int &width, int &height,
+                                        int &channels, DecodeStatus &status, const char *&reason)
+{
+    unsigned char *img = stbi_load_from_memory(data, static_cast<int>(bytes), &width, &height, &channels, 0);
+    if (img != NULL)
+    {
+        status = DECODE_OK;
+        return img;
+    }
+    reason = stbi_failure_reason();
+    status = DECODE_CORRUPT;
+    return nullptr;
+}
+
+#if defined(_WIN32)
+
+// No fork: decode in process
+unsigned char *decode_image_sandboxed(const char *path, int &width, int &height, int &channels,
+                                      DecodeStatus &status, const char *&reason, int)
+{
+    return decode_image(path, width, height, channels, status, reason);
+}
+
+unsigned char *decode_image_from_memory_sandboxed(const unsigned char *data, size_t bytes, int &width, int &height,
+                                                  int &channels, DecodeStatus &status, const char *&reason, int)
+{
+    return decode_image_from_memory(data, bytes, width, height, channels, status, reason);
+}
+
+#else
+
+// What the child sends ahead of the pixels
+struct DecodeReply
+{
+    int width;
+    int height;
+    int channels;
+    DecodeStatus status;
+    const char *reason;
+};
+
+static bool read_all(int fd, void *data, size_t bytes)
+{
+    unsigned char *p = static_cast<unsigned char *>(data);
+    while (bytes > 0)
+    {
+        const ssize_t n = read(fd, p, bytes);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void *data, size_t bytes)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    while (bytes > 0)
+    {
+        const ssize_t n = write(fd, p, bytes);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Run decode(width, height, channels, status, reason) in a forked child;
+// the child has a copy of everything the decode reads
+template <typename Decode>
+static unsigned char *run_sandboxed(Decode decode, int &width, int &height, int &channels, DecodeStatus &status,
+                                    const char *&reason, int timeout_seconds)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+    {
+        status = DECODE_UNREADABLE;
+        reason = "cannot create the decoder pipe";
+        return nullptr;
+    }
+    const pid_t child = fork();
+    if (child < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        status = DECODE_UNREADABLE;
+        reason = "cannot fork the decoder";
+        return nullptr;
+    }
+
+    if (child == 0)
+    {
+        // SIGALRM's default action ends a decoder that hangs
+        close(fds[0]);
+        alarm(static_cast<unsigned>(timeout_seconds));
+        DecodeReply reply = {};
+        unsigned char *img = decode(reply.width, reply.height, reply.channels, reply.status, reply.reason);
+        bool sent = write_all(fds[1], &reply, sizeof(reply));
+        if (img != nullptr && sent)
+            sent = write_all(fds[1], img, static_cast<size_t>(reply.width) * reply.height * reply.channels);
+        _exit(sent ? 0 : 1); // no atexit handlers or stdio flushes of the parent's state
+    }
+
+    close(fds[1]);
+    DecodeReply reply;
+    unsigned char *img = nullptr;
+    bool received = read_all(fds[0], &reply, sizeof(reply));
+    if (received && reply.status == DECODE_OK)
+    {
+        // stbi_image_free is free(), so the caller cannot tell this from stbi_load
+        const size_t bytes = static_cast<size_t>(reply.width) * reply.height * reply.channels;
+        img = static_cast<unsigned char *>(malloc(bytes));
+        received = img != nullptr && read_all(fds[0], img, bytes);
+    }
+    close(fds[0]);
+
+    int wait_status = 0;
+    while (waitpid(child, &wait_status, 0) < 0 && errno == EINTR)
+    {
+    }
+    if (!received || WIFSIGNALED(wait_status))
+    {
+        free(img);
+        const bool timed_out = WIFSIGNALED(wait_status) && WTERMSIG(wait_status) == SIGALRM;
+        status = timed_out ? DECODE_TIMED_OUT : DECODE_CRASHED;
+        reason = timed_out ? "decoder timed out" : "decoder crashed";
+        return nullptr;
+    }
+
+    status = reply.status;
+    if (status != DECODE_OK)
+    {
+        // stb's reasons are string literals, at the same address in the forked child
+        reason = reply.reason;
+        return nullptr;
+    }
+    width = reply.width;
+    height = reply.height;
+    channels = reply.channels;
+    return img;
+}
+
+unsigned char *decode_image_sandboxed(const char *path, int &width, int &height, int &channels,
+                                      DecodeStatus &status, const char *&reason, int timeout_seconds)
+{
+    return run_sandboxed([&](int &w, int &h, int &c, DecodeStatus &s, const char *&r)
+                         { return decode_image(path, w, h, c, s, r); },
+                         width, height, channels, status, reason, timeout_seconds);
+}
+
+unsigned char *decode_image_from_memory_sandboxed(const unsigned char *data, size_t bytes, int &width, int &height,
+                                                  int &channels, DecodeStatus &status, const char *&reason,
+                                                  int timeout_seconds)
+{
+    return run_sandboxed([&](int &w, int &h, int &c, DecodeStatus &s, const char *&r)
+                         { return decode_image_from_memory(data, bytes, w, h, c, s, r); },
+                         width, height, channels, status, reason, timeout_seconds);
+}
+
+#endif
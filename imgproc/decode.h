@@ -0,0 +1,39 @@
+#ifndef IMGPROC_DECODE_H
+#define IMGPROC_DECODE_H
+
+#include <cstddef>
+
+// Image decoding with the failure classified, so callers can log, retry or
+// skip a file. On failure `reason` points to a static string (usually
+// stbi_failure_reason()), so neither path allocates beyond the pixels.
+
+enum DecodeStatus
+{
+    DECODE_OK = 0,
+    DECODE_UNREADABLE = 1, // cannot open or read the file; may be worth a retry
+    DECODE_CORRUPT = 2,    // not an image stb_image can decode
+    DECODE_CRASHED = 3,    // the sandboxed decoder died on a signal
+    DECODE_TIMED_OUT = 4   // the sandboxed decoder ran past its time limit
+};
+
+const char *decode_status_name(DecodeStatus status);
+
+// stbi_load(path, ..., 0). Free the result with stbi_image_free.
+unsigned char *decode_image(const char *path, int &width, int &height, int &channels, DecodeStatus &status,
+                            const char *&reason);
+
+// stbi_load_from_memory of an encoded image; failures are DECODE_CORRUPT
+unsigned char *decode_image_from_memory(const unsigned char *data, size_t bytes, int &width, int &height,
+                                        int &channels, DecodeStatus &status, const char *&reason);
+
+// The same decodes in a forked child that sends the pixels back over a pipe,
+// so an image that crashes or hangs the decoder costs only that image. The
+// child is killed after `timeout_seconds`. Costs a fork and a copy of the
+// pixels per image.
+unsigned char *decode_image_sandboxed(const char *path, int &width, int &height, int &channels,
+                                      DecodeStatus &status, const char *&reason, int timeout_seconds = 10);
+unsigned char *decode_image_from_memory_sandboxed(const unsigned char *data, size_t bytes, int &width, int &height,
+                                                  int &channels, DecodeStatus &status, const char *&reason,
+                                                  int timeout_seconds = 10);
+
+#endif
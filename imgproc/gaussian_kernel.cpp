@@ -0,0 +1,97 @@
+#include "gaussian_kernel.h"
+
+#include <omp.h>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Compile-time tables for the radii the stencil dispatcher specialises
+static constexpr GaussianTaps<1> TAPS_R1 = make_gaussian_taps<1>(0.5);
+static constexpr GaussianTaps<2> TAPS_R2 = make_gaussian_taps<2>(1.0);
+static constexpr GaussianTaps<3> TAPS_R3 = make_gaussian_taps<3>(1.5);
+static constexpr GaussianTaps<5> TAPS_R5 = make_gaussian_taps<5>(2.5);
+static constexpr GaussianTaps<10> TAPS_R10 = make_gaussian_taps<10>(5.0);
+
+static_assert(TAPS_R10.fixed[10] > TAPS_R10.fixed[9], "Gaussian taps must peak at the centre");
+
+template <int R>
+static GaussianKernel from_taps(const GaussianTaps<R> &taps, float sigma)
+{
+    return {R, sigma, taps.weights.data(), taps.fixed.data()};
+}
+
+struct CachedKernel
+{
+    vector<float> weights;
+    vector<short> fixed;
+};
+
+// Keyed by the bit pattern of sigma so equal floats always hit
+static map<pair<unsigned, int>, CachedKernel> kernel_cache;
+
+static CachedKernel compute_kernel(float sigma, int radius)
+{
+    const int taps = 2 * radius + 1;
+    CachedKernel kernel;
+    kernel.weights.resize(taps);
+    kernel.fixed.resize(taps);
+
+    vector<double> raw(taps);
+    double total = 0.0;
+    for (int k = -radius; k <= radius; k++)
+    {
+        raw[k + radius] = exp(-(k * k) / (2.0 * sigma * sigma));
+        total += raw[k + radius];
+    }
+
+    int fixed_total = 0;
+    for (int k = 0; k < taps; k++)
+    {
+        kernel.weights[k] = static_cast<float>(raw[k] / total);
+        kernel.fixed[k] = static_cast<short>(raw[k] / total * (1 << GAUSSIAN_FIXED_SHIFT) + 0.5);
+        fixed_total += kernel.fixed[k];
+    }
+    kernel.fixed[radius] += static_cast<short>((1 << GAUSSIAN_FIXED_SHIFT) - fixed_total);
+    return kernel;
+}
+
+GaussianKernel gaussian_kernel(float sigma, int radius)
+{
+    if (sigma * 2 == static_cast<float>(radius))
+    {
+        switch (radius)
+        {
+        case 1:
+            return from_taps(TAPS_R1, sigma);
+        case 2:
+            return from_taps(TAPS_R2, sigma);
+        case 3:
+            return from_taps(TAPS_R3, sigma);
+        case 5:
+            return from_taps(TAPS_R5, sigma);
+        case 10:
+            return from_taps(TAPS_R10, sigma);
+        }
+    }
+
+    unsigned sigma_bits;
+    memcpy(&sigma_bits, &sigma, sizeof(sigma_bits));
+    const pair<unsigned, int> key(sigma_bits, radius);
+
+    GaussianKernel result;
+#pragma omp critical(gaussian_kernel_cache)
+    {
+        auto it = kernel_cache.find(key);
+        if (it == kernel_cache.end())
+        {
+            it = kernel_cache.emplace(key, compute_kernel(sigma, radius)).first;
+        }
+        // std::map nodes never move, so the pointers outlive the lock
+        result = {radius, sigma, it->second.weights.data(), it->second.fixed.data()};
+    }
+    return result;
+}
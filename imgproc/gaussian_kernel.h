@@ -0,0 +1,86 @@
+#ifndef IMGPROC_GAUSSIAN_KERNEL_H
+#define IMGPROC_GAUSSIAN_KERNEL_H
+
+#include <array>
+
+// Normalised separable 1D Gaussian weights.
+//
+// The 2D kernel is the outer product of `weights` with itself. `fixed` holds
+// the same taps in Q14 (they sum to exactly 1 << 14) for the integer path.
+// Pointers refer to static or cached storage and stay valid for the whole run.
+struct GaussianKernel
+{
+    int radius;
+    float sigma;
+    const float *weights;
+    const short *fixed;
+};
+
+enum KernelPrecision
+{
+    PRECISION_FLOAT, // float taps, result truncated like the original 2D loops
+    PRECISION_FIXED  // Q14 taps, 16-bit intermediates, result rounded
+};
+
+const int GAUSSIAN_FIXED_SHIFT = 14;
+
+// Kernel for (sigma, radius). sigma == radius / 2 for radius in {1, 2, 3, 5, 10}
+// comes from tables generated at compile time; anything else is computed on
+// first use and cached, so batch runs pay the exp() setup once per process.
+GaussianKernel gaussian_kernel(float sigma, int radius);
+
+// exp() for x <= 0 usable in constant expressions: halve x until it is small,
+// sum the Taylor series, then square back up
+constexpr double constexpr_exp(double x)
+{
+    int halvings = 0;
+    while (x < -0.5)
+    {
+        x /= 2;
+        halvings++;
+    }
+    double term = 1.0, sum = 1.0;
+    for (int n = 1; n < 20; n++)
+    {
+        term *= x / n;
+        sum += term;
+    }
+    while (halvings-- > 0)
+    {
+        sum *= sum;
+    }
+    return sum;
+}
+
+template <int R>
+struct GaussianTaps
+{
+    std::array<float, 2 * R + 1> weights;
+    std::array<short, 2 * R + 1> fixed;
+};
+
+template <int R>
+constexpr GaussianTaps<R> make_gaussian_taps(double sigma)
+{
+    GaussianTaps<R> taps{};
+    double raw[2 * R + 1] = {};
+    double total = 0.0;
+    for (int k = -R; k <= R; k++)
+    {
+        raw[k + R] = constexpr_exp(-(k * k) / (2 * sigma * sigma));
+        total += raw[k + R];
+    }
+
+    // Round the fixed taps and give the remainder to the centre so they sum to one
+    int fixed_total = 0;
+    for (int k = 0; k < 2 * R + 1; k++)
+    {
+        taps.weights[k] = static_cast<float>(raw[k] / total);
+        taps.fixed[k] = static_cast<short>(raw[k] / total * (1 << GAUSSIAN_FIXED_SHIFT) + 0.5);
+        fixed_total += taps.fixed[k];
+    }
+    taps.fixed[R] += static_cast<short>((1 << GAUSSIAN_FIXED_SHIFT) - fixed_total);
+    return taps;
+}
+
+#endif
@@ -0,0 +1,260 @@
+#include "geometry.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+using namespace std;
+
+static const int TILE = 64;
+
+// Reverse the order of `width` pixels from `in` into `out` (no overlap)
+static void flip_row(const unsigned char *in, unsigned char *out, int width, int c)
+{
+    int x = 0;
+    if (c == 1)
+    {
+#if defined(__AVX2__)
+        const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                                 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        for (; x + 32 <= width; x += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + width - x - 32));
+            v = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, reverse), 0x4E);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), v);
+        }
+#endif
+        for (; x < width; x++)
+            out[x] = in[width - 1 - x];
+        return;
+    }
+    if (c == 4)
+    {
+#if defined(__AVX2__)
+        const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        for (; x + 8 <= width; x += 8)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + (width - x - 8) * 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x * 4), _mm256_permutevar8x32_epi32(v, reverse));
+        }
+#endif
+        for (; x < width; x++)
+            memcpy(out + x * 4, in + (width - 1 - x) * 4, 4);
+        return;
+    }
+    if (c == 3)
+    {
+#if defined(__SSSE3__)
+        // Five pixels per step. The 16-byte load starts one byte before them,
+        // and the 16th byte stored is overwritten by the next step (or the tail).
+        const __m128i reverse = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, 0);
+        for (; x + 6 <= width; x += 5)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + (width - x - 5) * 3 - 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x * 3), _mm_shuffle_epi8(v, reverse));
+        }
+#endif
+        for (; x < width; x++)
+            memcpy(out + x * 3, in + (width - 1 - x) * 3, 3);
+        return;
+    }
+    for (; x < width; x++)
+        memcpy(out + x * c, in + (width - 1 - x) * c, c);
+}
+
+void apply_flip_horizontal(const ImageView &src, const ImageView &dst)
+{
+    const bool in_place = src.data == dst.data;
+#pragma omp parallel
+    {
+        vector<unsigned char> row(in_place ? src.row_bytes() : 0);
+#pragma omp for
+        for (int y = 0; y < src.height; y++)
+        {
+            const unsigned char *in = src.row(y);
+            if (in_place)
+            {
+                memcpy(row.data(), in, row.size());
+                in = row.data();
+            }
+            flip_row(in, dst.row(y), src.width, src.channels);
+        }
+    }
+}
+
+void apply_flip_horizontal(const ImageView &img)
+{
+    apply_flip_horizontal(img, img);
+}
+
+void apply_flip_vertical(const ImageView &src, const ImageView &dst)
+{
+    const int row_bytes = src.row_bytes();
+    const int height = src.height;
+    if (src.data != dst.data)
+    {
+#pragma omp parallel for
+        for (int y = 0; y < height; y++)
+            memcpy(dst.row(height - 1 - y), src.row(y), row_bytes);
+        return;
+    }
+
+#pragma omp parallel
+    {
+        vector<unsigned char> row(row_bytes);
+#pragma omp for
+        for (int y = 0; y < height / 2; y++)
+        {
+            memcpy(row.data(), dst.row(y), row_bytes);
+            memcpy(dst.row(y), dst.row(height - 1 - y), row_bytes);
+            memcpy(dst.row(height - 1 - y), row.data(), row_bytes);
+        }
+    }
+}
+
+void apply_flip_vertical(const ImageView &img)
+{
+    apply_flip_vertical(img, img);
+}
+
+// dst(i, j) = src(j, i), with the source column read backwards when
+// `reverse_columns` (rotate 270) or the source rows read bottom-up when
+// `reverse_rows` (rotate 90). One tile of dst rows [j0, j1) x columns [i0, i1).
+template <int C>
+static void transpose_tile(const ImageView &src, const ImageView &dst, int i0, int i1, int j0, int j1,
+                           bool reverse_rows, bool reverse_columns)
+{
+    const int c = C > 0 ? C : src.channels;
+    const ptrdiff_t step = reverse_rows ? -static_cast<ptrdiff_t>(src.stride) : src.stride;
+    for (int j = j0; j < j1; j++)
+    {
+        const int sx = reverse_columns ? src.width - 1 - j : j;
+        const unsigned char *in = src.row(reverse_rows ? src.height - 1 - i0 : i0) + sx * c;
+        unsigned char *out = dst.row(j) + i0 * c;
+        for (int i = i0; i < i1; i++, in += step, out += c)
+        {
+            memcpy(out, in, c);
+        }
+    }
+}
+
+template <int C>
+static void transpose_tiled(const ImageView &src, const ImageView &dst, bool reverse_rows, bool reverse_columns)
+{
+    const int tiles_x = (dst.width + TILE - 1) / TILE;
+    const int tiles_y = (dst.height + TILE - 1) / TILE;
+#pragma omp parallel for collapse(2)
+    for (int ty = 0; ty < tiles_y; ty++)
+    {
+        for (int tx = 0; tx < tiles_x; tx++)
+        {
+            const int i0 = tx * TILE, i1 = min(i0 + TILE, dst.width);
+            const int j0 = ty * TILE, j1 = min(j0 + TILE, dst.height);
+            transpose_tile<C>(src, dst, i0, i1, j0, j1, reverse_rows, reverse_columns);
+        }
+    }
+}
+
+static void transpose_any(const ImageView &src, const ImageView &dst, bool reverse_rows, bool reverse_columns)
+{
+    switch (src.channels)
+    {
+    case 1:
+        transpose_tiled<1>(src, dst, reverse_rows, reverse_columns);
+        break;
+    case 3:
+        transpose_tiled<3>(src, dst, reverse_rows, reverse_columns);
+        break;
+    case 4:
+        transpose_tiled<4>(src, dst, reverse_rows, reverse_columns);
+        break;
+    default:
+        transpose_tiled<0>(src, dst, reverse_rows, reverse_columns);
+        break;
+    }
+}
+
+void apply_transpose(const ImageView &src, const ImageView &dst)
+{
+    transpose_any(src, dst, false, false);
+}
+
+// Row y of dst is row height - 1 - y of src reversed. In place the two rows
+// of a pair are read into buffers before either is written.
+static void rotate_180(const ImageView &src, const ImageView &dst)
+{
+    const int height = src.height;
+    const int row_bytes = src.row_bytes();
+    if (src.data != dst.data)
+    {
+#pragma omp parallel for
+        for (int y = 0; y < height; y++)
+            flip_row(src.row(height - 1 - y), dst.row(y), src.width, src.channels);
+        return;
+    }
+
+#pragma omp parallel
+    {
+        vector<unsigned char> top(row_bytes), bottom(row_bytes);
+#pragma omp for
+        for (int y = 0; y < (height + 1) / 2; y++)
+        {
+            memcpy(top.data(), src.row(y), row_bytes);
+            memcpy(bottom.data(), src.row(height - 1 - y), row_bytes);
+            flip_row(bottom.data(), dst.row(y), src.width, src.channels);
+            flip_row(top.data(), dst.row(height - 1 - y), src.width, src.channels);
+        }
+    }
+}
+
+void apply_rotation(const ImageView &src, const ImageView &dst, Rotation rotation)
+{
+    switch (rotation)
+    {
+    case ROTATE_90:
+        transpose_any(src, dst, true, false);
+        break;
+    case ROTATE_180:
+        rotate_180(src, dst);
+        break;
+    case ROTATE_270:
+        transpose_any(src, dst, false, true);
+        break;
+    }
+}
+
+void apply_affine(const ImageView &src, const ImageView &dst, const float m[6])
+{
+    const int c = dst.channels;
+    const float max_x = static_cast<float>(src.width - 1), max_y = static_cast<float>(src.height - 1);
+
+#pragma omp parallel for
+    for (int y = 0; y < dst.height; y++)
+    {
+        unsigned char *out = dst.row(y);
+        for (int x = 0; x < dst.width; x++, out += c)
+        {
+            const float sx = min(max(m[0] * x + m[1] * y + m[2], 0.0f), max_x);
+            const float sy = min(max(m[3] * x + m[4] * y + m[5], 0.0f), max_y);
+            const int x0 = static_cast<int>(sx), y0 = static_cast<int>(sy);
+            const int x1 = min(x0 + 1, src.width - 1), y1 = min(y0 + 1, src.height - 1);
+            const float fx = sx - x0, fy = sy - y0;
+            const unsigned char *p00 = src.pixel(x0, y0), *p01 = src.pixel(x1, y0);
+            const unsigned char *p10 = src.pixel(x0, y1), *p11 = src.pixel(x1, y1);
+            for (int ch = 0; ch < c; ch++)
+            {
+                const float top = p00[ch] + fx * (p01[ch] - p00[ch]);
+                const float bottom = p10[ch] + fx * (p11[ch] - p10[ch]);
+                out[ch] = static_cast<unsigned char>(top + fy * (bottom - top) + 0.5f);
+            }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef IMGPROC_GEOMETRY_H
+#define IMGPROC_GEOMETRY_H
+
+#include "image_view.h"
+
+// Geometric transforms used for augmentation. The flips, transpose and
+// quarter turns are exact (they move whole pixels); apply_affine resamples.
+
+// Clockwise rotations
+enum Rotation
+{
+    ROTATE_90,
+    ROTATE_180,
+    ROTATE_270
+};
+
+// Mirror left <-> right, reversing pixels with SIMD shuffles (1, 3 and 4
+// channels). dst may be src.
+void apply_flip_horizontal(const ImageView &src, const ImageView &dst);
+void apply_flip_horizontal(const ImageView &img);
+
+// Mirror top <-> bottom with one memcpy per row; in place it swaps row pairs
+void apply_flip_vertical(const ImageView &src, const ImageView &dst);
+void apply_flip_vertical(const ImageView &img);
+
+// dst(x, y) = src(y, x); dst is src.height x src.width and must not overlap src.
+// Runs over 64 x 64 pixel tiles so both sides stay in cache.
+void apply_transpose(const ImageView &src, const ImageView &dst);
+
+// 90 and 270 give a src.height x src.width dst (tiled like the transpose and
+// must not overlap src); 180 keeps the size and dst may be src.
+void apply_rotation(const ImageView &src, const ImageView &dst, Rotation rotation);
+
+// dst(x, y) = src(m[0] x + m[1] y + m[2], m[3] x + m[4] y + m[5]), sampled
+// bilinearly; coordinates are pixel centres and points outside src take the
+// nearest edge pixel. dst can have any size (resize, rotation and zoom in
+// one pass) and must not overlap src, which must have dst.channels.
+void apply_affine(const ImageView &src, const ImageView &dst, const float m[6]);
+
+#endif
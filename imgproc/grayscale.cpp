@@ -0,0 +1,227 @@
+#include "kernels.h"
+
+#include <omp.h>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+// 0.3 R + 0.59 G + 0.11 B with Q16 weights that sum to 65536. Each product is
+// taken as mulhi(v << 8, w), which is exactly what _mm_mulhi_epu16 computes,
+// so the scalar and SIMD paths agree bit for bit. The bias compensates the
+// truncation of the three products.
+static const unsigned W_R = 19661;
+static const unsigned W_G = 38666;
+static const unsigned W_B = 7209;
+static const unsigned ROUND_BIAS = 2;
+
+static inline unsigned char gray_of(unsigned r, unsigned g, unsigned b)
+{
+    unsigned t = (((r << 8) * W_R) >> 16) + (((g << 8) * W_G) >> 16) + (((b << 8) * W_B) >> 16);
+    return static_cast<unsigned char>((t + ROUND_BIAS) >> 8);
+}
+
+// Scalar row for a compile-time channel count; out_c is 1 or C
+template <int C>
+static void gray_row_fixed(const unsigned char *in, unsigned char *out, int count, int out_c)
+{
+    if (out_c == 1)
+    {
+        for (int x = 0; x < count; x++, in += C)
+        {
+            out[x] = gray_of(in[0], in[1], in[2]);
+        }
+        return;
+    }
+    for (int x = 0; x < count; x++, in += C, out += C)
+    {
+        unsigned char g = gray_of(in[0], in[1], in[2]);
+        if (C == 4)
+            out[3] = in[3];
+        out[0] = out[1] = out[2] = g;
+    }
+}
+
+static void gray_row_generic(const unsigned char *in, unsigned char *out, int count, int c, int out_c)
+{
+    for (int x = 0; x < count; x++, in += c)
+    {
+        unsigned char g = gray_of(in[0], in[1], in[2]);
+        if (out_c == 1)
+        {
+            out[x] = g;
+            continue;
+        }
+        unsigned char *o = out + x * c;
+        memmove(o + 3, in + 3, c - 3);
+        o[0] = o[1] = o[2] = g;
+    }
+}
+
+#if defined(__SSSE3__)
+// pshufb masks for 16 pixels of C interleaved channels (C 16-byte vectors):
+// pick[k][s] moves channel k of vector s into its pixel lane, expand[s] writes
+// gray back into the colour bytes of output vector s, keep[s] selects alpha.
+template <int C>
+struct GrayMasks
+{
+    __m128i pick[3][C];
+    __m128i expand[C];
+    __m128i keep[C];
+};
+
+template <int C>
+static const GrayMasks<C> &gray_masks()
+{
+    static const GrayMasks<C> masks = [] {
+        GrayMasks<C> m;
+        alignas(16) unsigned char bytes[16];
+        alignas(16) unsigned char keep[16];
+        for (int k = 0; k < 3; k++)
+        {
+            for (int s = 0; s < C; s++)
+            {
+                for (int p = 0; p < 16; p++)
+                {
+                    int index = C * p + k - 16 * s;
+                    bytes[p] = (index >= 0 && index < 16) ? index : 0x80;
+                }
+                m.pick[k][s] = _mm_load_si128(reinterpret_cast<const __m128i *>(bytes));
+            }
+        }
+        for (int s = 0; s < C; s++)
+        {
+            for (int j = 0; j < 16; j++)
+            {
+                int byte = 16 * s + j;
+                bool colour = byte % C < 3;
+                bytes[j] = colour ? byte / C : 0x80;
+                keep[j] = colour ? 0x00 : 0xFF;
+            }
+            m.expand[s] = _mm_load_si128(reinterpret_cast<const __m128i *>(bytes));
+            m.keep[s] = _mm_load_si128(reinterpret_cast<const __m128i *>(keep));
+        }
+        return m;
+    }();
+    return masks;
+}
+
+// Converts whole blocks of 16 pixels and returns how many pixels were done
+template <int C, bool EXPAND>
+static int gray_row_ssse3(const unsigned char *in, unsigned char *out, int count)
+{
+    const GrayMasks<C> &m = gray_masks<C>();
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wr = _mm_set1_epi16(static_cast<short>(W_R));
+    const __m128i wg = _mm_set1_epi16(static_cast<short>(W_G));
+    const __m128i wb = _mm_set1_epi16(static_cast<short>(W_B));
+    const __m128i bias = _mm_set1_epi16(ROUND_BIAS);
+
+    int x = 0;
+    for (; x + 16 <= count; x += 16, in += 16 * C, out += EXPAND ? 16 * C : 16)
+    {
+        __m128i v[C];
+        for (int s = 0; s < C; s++)
+        {
+            v[s] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * s));
+        }
+
+        // Deinterleave R, G and B into one vector each
+        __m128i ch[3];
+        for (int k = 0; k < 3; k++)
+        {
+            ch[k] = _mm_shuffle_epi8(v[0], m.pick[k][0]);
+            for (int s = 1; s < C; s++)
+            {
+                ch[k] = _mm_or_si128(ch[k], _mm_shuffle_epi8(v[s], m.pick[k][s]));
+            }
+        }
+
+        // Unpacking with zero in the low byte yields v << 8 per 16-bit lane
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(zero, ch[0]), wr),
+                                                 _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, ch[1]), wg)),
+                                   _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, ch[2]), wb));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mulhi_epu16(_mm_unpackhi_epi8(zero, ch[0]), wr),
+                                                 _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, ch[1]), wg)),
+                                   _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, ch[2]), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, bias), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, bias), 8);
+        __m128i gray = _mm_packus_epi16(lo, hi);
+
+        if (!EXPAND)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), gray);
+            continue;
+        }
+        for (int s = 0; s < C; s++)
+        {
+            __m128i o = _mm_shuffle_epi8(gray, m.expand[s]);
+            if (C == 4)
+                o = _mm_or_si128(o, _mm_and_si128(v[s], m.keep[s]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * s), o);
+        }
+    }
+    return x;
+}
+#endif
+
+static void gray_row(const unsigned char *in, unsigned char *out, int count, int c, int out_c)
+{
+    int done = 0;
+#if defined(__SSSE3__)
+    if (c == 3)
+        done = out_c == 1 ? gray_row_ssse3<3, false>(in, out, count) : gray_row_ssse3<3, true>(in, out, count);
+    else if (c == 4)
+        done = out_c == 1 ? gray_row_ssse3<4, false>(in, out, count) : gray_row_ssse3<4, true>(in, out, count);
+#endif
+    in += done * c;
+    out += done * out_c;
+    count -= done;
+
+    if (c == 3)
+        gray_row_fixed<3>(in, out, count, out_c);
+    else if (c == 4)
+        gray_row_fixed<4>(in, out, count, out_c);
+    else
+        gray_row_generic(in, out, count, c, out_c);
+}
+
+void apply_grayscale(const ImageView &src, const ImageView &dst)
+{
+    const int c = src.channels;
+    const int out_c = dst.channels;
+
+    // One and two channel images are gray already (in channel 0)
+    if (c < 3)
+    {
+        if (out_c == c)
+        {
+            if (src.data != dst.data)
+                copy_image(src, dst);
+            return;
+        }
+#pragma omp parallel for
+        for (int y = 0; y < src.height; y++)
+        {
+            const unsigned char *in = src.row(y);
+            unsigned char *out = dst.row(y);
+            for (int x = 0; x < src.width; x++)
+            {
+                out[x] = in[x * c];
+            }
+        }
+        return;
+    }
+
+#pragma omp parallel for
+    for (int y = 0; y < src.height; y++)
+    {
+        gray_row(src.row(y), dst.row(y), src.width, c, out_c);
+    }
+}
+
+void apply_grayscale(const ImageView &img)
+{
+    apply_grayscale(img, img);
+}
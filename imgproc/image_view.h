@@ -0,0 +1,40 @@
+#ifndef IMGPROC_IMAGE_VIEW_H
+#define IMGPROC_IMAGE_VIEW_H
+
+#include <cstddef>
+
+// Non-owning view of an interleaved 8-bit image.
+// `stride` is the distance in bytes between the starts of two consecutive rows,
+// so a view can describe a crop, a tile or the interior of a padded buffer
+// without copying. Kernels only ever address pixels through row().
+struct ImageView
+{
+    unsigned char *data;
+    int width;
+    int height;
+    int channels;
+    int stride;
+
+    ImageView() : data(nullptr), width(0), height(0), channels(0), stride(0) {}
+
+    ImageView(unsigned char *data, int width, int height, int channels)
+        : data(data), width(width), height(height), channels(channels), stride(width * channels) {}
+
+    ImageView(unsigned char *data, int width, int height, int channels, int stride)
+        : data(data), width(width), height(height), channels(channels), stride(stride) {}
+
+    unsigned char *row(int y) const { return data + static_cast<ptrdiff_t>(y) * stride; }
+    unsigned char *pixel(int x, int y) const { return row(y) + x * channels; }
+
+    int row_bytes() const { return width * channels; }
+    bool empty() const { return data == nullptr || width <= 0 || height <= 0; }
+    bool is_contiguous() const { return stride == width * channels; }
+
+    // Sub-region starting at (x, y); shares the pixels and the stride of this view
+    ImageView roi(int x, int y, int w, int h) const
+    {
+        return ImageView(pixel(x, y), w, h, channels, stride);
+    }
+};
+
+#endif
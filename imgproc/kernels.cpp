@@ -0,0 +1,701 @@
+#include "kernels.h"
+#include "padded_image.h"
+#include "stencil.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static inline unsigned char clamp_u8(int v)
+{
+    return static_cast<unsigned char>(min(max(v, 0), 255));
+}
+
+void copy_image(const ImageView &src, const ImageView &dst)
+{
+    const int row_bytes = src.row_bytes();
+    if (src.is_contiguous() && dst.is_contiguous())
+    {
+        memcpy(dst.data, src.data, static_cast<size_t>(row_bytes) * src.height);
+        return;
+    }
+    for (int y = 0; y < src.height; y++)
+    {
+        memcpy(dst.row(y), src.row(y), row_bytes);
+    }
+}
+
+// Run a stencil of `radius` whose core reads the halo of `src` directly.
+// Unless the caller promises a valid halo, the source is first copied once
+// into a padded buffer whose border is filled according to `border`.
+template <typename Core>
+static void run_stencil(const ImageView &src, const ImageView &dst, int radius, BorderMode border, Core core)
+{
+    if (border == BORDER_HALO && src.data != dst.data)
+    {
+        core(src, dst);
+        return;
+    }
+    PaddedImage padded(src, radius, border);
+    core(padded.view(), dst);
+}
+
+struct GaussianBlur3x3
+{
+    template <int C, int R>
+    static void run(const ImageView &src, const ImageView &dst)
+    {
+        const int c = C ? C : src.channels;
+        const int row_bytes = src.width * c;
+#pragma omp parallel
+        {
+            // Vertical [1 2 1] pass into a row of sums, then horizontal [1 2 1] and / 16
+            vector<unsigned short> vsum(row_bytes + 2 * c);
+#pragma omp for
+            for (int y = 0; y < src.height; y++)
+            {
+                const unsigned char *r0 = src.row(y - 1) - c;
+                const unsigned char *r1 = src.row(y) - c;
+                const unsigned char *r2 = src.row(y + 1) - c;
+                for (int i = 0; i < row_bytes + 2 * c; i++)
+                {
+                    vsum[i] = r0[i] + 2 * r1[i] + r2[i];
+                }
+
+                const unsigned short *v = vsum.data();
+                unsigned char *out = dst.row(y);
+                for (int i = 0; i < row_bytes; i++)
+                {
+                    out[i] = static_cast<unsigned char>((v[i] + 2 * v[i + c] + v[i + 2 * c]) >> 4);
+                }
+            }
+        }
+    }
+};
+
+void apply_gaussian_blur(const ImageView &src, const ImageView &dst, BorderMode border)
+{
+    run_stencil(src, dst, 1, border, [](const ImageView &in, const ImageView &out) {
+        dispatch_channels<GaussianBlur3x3>(in.channels, in, out);
+    });
+}
+
+void apply_gaussian_blur(const ImageView &img, BorderMode border)
+{
+    apply_gaussian_blur(img, img, border);
+}
+
+struct SeparableBlur
+{
+    template <int C, int R>
+    static void run(const ImageView &src, const ImageView &dst, int radius, const float *weights)
+    {
+        const int c = C ? C : src.channels;
+        const int r = R ? R : radius;
+        const int taps = 2 * r + 1;
+        const int row_bytes = src.width * c;
+        const int halo = r * c;
+#pragma omp parallel
+        {
+            vector<float> vsum(row_bytes + 2 * halo);
+            vector<float> hsum(row_bytes);
+#pragma omp for
+            for (int y = 0; y < src.height; y++)
+            {
+                float *v = vsum.data();
+                const unsigned char *line = src.row(y - r) - halo;
+                for (int i = 0; i < row_bytes + 2 * halo; i++)
+                {
+                    v[i] = weights[0] * line[i];
+                }
+                for (int k = 1; k < taps; k++)
+                {
+                    line = src.row(y + k - r) - halo;
+                    const float w = weights[k];
+                    for (int i = 0; i < row_bytes + 2 * halo; i++)
+                    {
+                        v[i] += w * line[i];
+                    }
+                }
+
+                unsigned char *out = dst.row(y);
+                if (R && R <= 5)
+                {
+                    // Short unrolled window per output pixel
+                    for (int i = 0; i < row_bytes; i++)
+                    {
+                        float sum = 0.0f;
+                        for (int k = 0; k < taps; k++)
+                        {
+                            sum += weights[k] * v[i + k * c];
+                        }
+                        out[i] = clamp_u8(static_cast<int>(sum));
+                    }
+                    continue;
+                }
+
+                // Wide or runtime windows: accumulate tap by tap (same summation order)
+                float *h = hsum.data();
+                for (int i = 0; i < row_bytes; i++)
+                {
+                    h[i] = weights[0] * v[i];
+                }
+                for (int k = 1; k < taps; k++)
+                {
+                    const float w = weights[k];
+                    const float *shifted = v + k * c;
+                    for (int i = 0; i < row_bytes; i++)
+                    {
+                        h[i] += w * shifted[i];
+                    }
+                }
+                for (int i = 0; i < row_bytes; i++)
+                {
+                    out[i] = clamp_u8(static_cast<int>(h[i]));
+                }
+            }
+        }
+    }
+};
+
+struct SeparableBlurFixed
+{
+    template <int C, int R>
+    static void run(const ImageView &src, const ImageView &dst, int radius, const short *weights)
+    {
+        const int c = C ? C : src.channels;
+        const int r = R ? R : radius;
+        const int taps = 2 * r + 1;
+        const int row_bytes = src.width * c;
+        const int halo = r * c;
+        // Vertical pass in Q14, stored as Q8 so the horizontal Q14 pass fits in 32 bits
+        const int to_q8 = GAUSSIAN_FIXED_SHIFT - 8;
+        const int to_u8 = GAUSSIAN_FIXED_SHIFT + 8;
+#pragma omp parallel
+        {
+            vector<int> acc(row_bytes + 2 * halo);
+            vector<unsigned short> vsum(row_bytes + 2 * halo);
+#pragma omp for
+            for (int y = 0; y < src.height; y++)
+            {
+                int *a = acc.data();
+                const unsigned char *line = src.row(y - r) - halo;
+                for (int i = 0; i < row_bytes + 2 * halo; i++)
+                {
+                    a[i] = weights[0] * line[i];
+                }
+                for (int k = 1; k < taps; k++)
+                {
+                    line = src.row(y + k - r) - halo;
+                    const int w = weights[k];
+                    for (int i = 0; i < row_bytes + 2 * halo; i++)
+                    {
+                        a[i] += w * line[i];
+                    }
+                }
+                unsigned short *v = vsum.data();
+                for (int i = 0; i < row_bytes + 2 * halo; i++)
+                {
+                    v[i] = static_cast<unsigned short>((a[i] + (1 << (to_q8 - 1))) >> to_q8);
+                }
+
+                // Horizontal pass tap by tap into `acc`, so each step is a plain
+                // multiply-add over the row that vectorises like the vertical one
+                for (int i = 0; i < row_bytes; i++)
+                {
+                    a[i] = weights[0] * v[i];
+                }
+                for (int k = 1; k < taps; k++)
+                {
+                    const int w = weights[k];
+                    const unsigned short *shifted = v + k * c;
+                    for (int i = 0; i < row_bytes; i++)
+                    {
+                        a[i] += w * shifted[i];
+                    }
+                }
+                unsigned char *out = dst.row(y);
+                for (int i = 0; i < row_bytes; i++)
+                {
+                    out[i] = static_cast<unsigned char>((a[i] + (1 << (to_u8 - 1))) >> to_u8);
+                }
+            }
+        }
+    }
+};
+
+void apply_gaussian_blur(const ImageView &src, const ImageView &dst, int radius, float sigma, BorderMode border,
+                         KernelPrecision precision)
+{
+    const GaussianKernel kernel = gaussian_kernel(sigma, radius);
+    run_stencil(src, dst, radius, border, [&](const ImageView &in, const ImageView &out) {
+        if (precision == PRECISION_FIXED)
+            dispatch_stencil<SeparableBlurFixed>(in.channels, radius, in, out, radius, kernel.fixed);
+        else
+            dispatch_stencil<SeparableBlur>(in.channels, radius, in, out, radius, kernel.weights);
+    });
+}
+
+void apply_gaussian_blur(const ImageView &img, int radius, float sigma, BorderMode border, KernelPrecision precision)
+{
+    apply_gaussian_blur(img, img, radius, sigma, border, precision);
+}
+
+struct Convolution3x3
+{
+    template <int C, int R>
+    static void run(const ImageView &src, const ImageView &dst, const float *kernel)
+    {
+        const int c = C ? C : src.channels;
+        const int row_bytes = src.width * c;
+        const float k0 = kernel[0], k1 = kernel[1], k2 = kernel[2];
+        const float k3 = kernel[3], k4 = kernel[4], k5 = kernel[5];
+        const float k6 = kernel[6], k7 = kernel[7], k8 = kernel[8];
+#pragma omp parallel for
+        for (int y = 0; y < src.height; y++)
+        {
+            const unsigned char *r0 = src.row(y - 1) - c;
+            const unsigned char *r1 = src.row(y) - c;
+            const unsigned char *r2 = src.row(y + 1) - c;
+            unsigned char *out = dst.row(y);
+            for (int i = 0; i < row_bytes; i++)
+            {
+                float sum = r0[i] * k0 + r0[i + c] * k1 + r0[i + 2 * c] * k2 +
+                            r1[i] * k3 + r1[i + c] * k4 + r1[i + 2 * c] * k5 +
+                            r2[i] * k6 + r2[i + c] * k7 + r2[i + 2 * c] * k8;
+                out[i] = clamp_u8(static_cast<int>(sum));
+            }
+        }
+    }
+};
+
+void apply_convolution_3x3(const ImageView &src, const ImageView &dst, const float kernel[9], BorderMode border)
+{
+    run_stencil(src, dst, 1, border, [&](const ImageView &in, const ImageView &out) {
+        dispatch_channels<Convolution3x3>(in.channels, in, out, kernel);
+    });
+}
+
+void apply_convolution_3x3(const ImageView &img, const float kernel[9], BorderMode border)
+{
+    apply_convolution_3x3(img, img, kernel, border);
+}
+
+struct Sharpening3x3
+{
+    template <int C, int R>
+    static void run(const ImageView &src, const ImageView &dst)
+    {
+        // 9 * centre - 8 neighbours == 10 * centre - (3x3 box sum)
+        const int c = C ? C : src.channels;
+        const int row_bytes = src.width * c;
+#pragma omp parallel
+        {
+            vector<unsigned short> vsum(row_bytes + 2 * c);
+#pragma omp for
+            for (int y = 0; y < src.height; y++)
+            {
+                const unsigned char *r0 = src.row(y - 1) - c;
+                const unsigned char *r1 = src.row(y) - c;
+                const unsigned char *r2 = src.row(y + 1) - c;
+                for (int i = 0; i < row_bytes + 2 * c; i++)
+                {
+                    vsum[i] = r0[i] + r1[i] + r2[i];
+                }
+
+                const unsigned short *v = vsum.data();
+                const unsigned char *centre = src.row(y);
+                unsigned char *out = dst.row(y);
+                for (int i = 0; i < row_bytes; i++)
+                {
+                    int box = v[i] + v[i + c] + v[i + 2 * c];
+                    out[i] = clamp_u8(10 * centre[i] - box);
+                }
+            }
+        }
+    }
+};
+
+void apply_sharpening(const ImageView &src, const ImageView &dst, BorderMode border)
+{
+    run_stencil(src, dst, 1, border, [](const ImageView &in, const ImageView &out) {
+        dispatch_channels<Sharpening3x3>(in.channels, in, out);
+    });
+}
+
+void apply_sharpening(const ImageView &img, BorderMode border)
+{
+    apply_sharpening(img, img, border);
+}
+
+// Number of channels that carry colour, i.e. excluding a trailing alpha channel
+static inline int colour_channels(int channels)
+{
+    return (channels == 2 || channels == 4) ? channels - 1 : channels;
+}
+
+static inline unsigned char sobel_direction(int gx, int gy)
+{
+    // tan(22.5 degrees) ~= 106 / 256
+    const int ax = abs(gx), ay = abs(gy);
+    if (ay * 256 <= ax * 106)
+        return SOBEL_DIR_0;
+    if (ax * 256 <= ay * 106)
+        return SOBEL_DIR_90;
+    return (gx > 0) == (gy > 0) ? SOBEL_DIR_45 : SOBEL_DIR_135;
+}
+
+// Magnitude of n outputs from the vertical [1 2 1] sums and [-1 0 1]
+// differences of a row, `k` entries apart horizontally:
+// gx = smooth[i + 2k] - smooth[i], gy = diff[i] + 2 diff[i + k] + diff[i + 2k]
+static void sobel_magnitude(const short *smooth, const short *diff, int k, int n, SobelNorm norm, unsigned char *out)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m256i gx = _mm256_sub_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(smooth + i + 2 * k)),
+                                            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(smooth + i)));
+        const __m256i gy = _mm256_add_epi16(
+            _mm256_add_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(diff + i)),
+                             _mm256_loadu_si256(reinterpret_cast<const __m256i *>(diff + i + 2 * k))),
+            _mm256_slli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(diff + i + k)), 1));
+
+        __m256i magnitude;
+        if (norm == SOBEL_L1)
+        {
+            magnitude = _mm256_add_epi16(_mm256_abs_epi16(gx), _mm256_abs_epi16(gy));
+        }
+        else
+        {
+            // Interleaved (gx, gy) pairs: madd gives gx^2 + gy^2 per 32-bit lane.
+            // sqrt is correctly rounded, so truncating it matches the scalar path.
+            const __m256i low = _mm256_unpacklo_epi16(gx, gy);
+            const __m256i high = _mm256_unpackhi_epi16(gx, gy);
+            const __m256i root_low = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(low, low))));
+            const __m256i root_high = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(high, high))));
+            magnitude = _mm256_packs_epi32(root_low, root_high);
+        }
+        // Saturate to 255 and bring the two 128-bit halves together
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(magnitude, magnitude), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_castsi256_si128(packed));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        const int gx = smooth[i + 2 * k] - smooth[i];
+        const int gy = diff[i] + 2 * diff[i + k] + diff[i + 2 * k];
+        const int magnitude = norm == SOBEL_L1 ? abs(gx) + abs(gy) : static_cast<int>(sqrt(static_cast<float>(gx * gx + gy * gy)));
+        out[i] = static_cast<unsigned char>(min(magnitude, 255));
+    }
+}
+
+// Vertical [1 2 1] sums and [-1 0 1] differences of `count` entries taken
+// every `step` bytes of three consecutive rows
+template <int STEP>
+static void sobel_row_sums(const unsigned char *r0, const unsigned char *r1, const unsigned char *r2, int step, int count,
+                           short *smooth, short *diff)
+{
+    const int s = STEP ? STEP : step;
+    for (int i = 0; i < count; i++)
+    {
+        smooth[i] = static_cast<short>(r0[i * s] + 2 * r1[i * s] + r2[i * s]);
+        diff[i] = static_cast<short>(r2[i * s] - r0[i * s]);
+    }
+}
+
+// Gray row into the colour channels of an interleaved row, alpha taken from
+// `in`. Kept out of the kernel loop, where the char stores stopped GCC from
+// keeping anything in registers.
+template <int C>
+static void broadcast_gray(const unsigned char *gray, const unsigned char *in, unsigned char *out, int width, int channels)
+{
+    const int c = C ? C : channels;
+    const int cc = colour_channels(c);
+    for (int x = 0; x < width; x++)
+    {
+        const unsigned char v = gray[x];
+        for (int ch = 0; ch < cc; ch++)
+            out[x * c + ch] = v;
+        if (cc != c)
+            out[x * c + cc] = in[x * c + cc];
+    }
+}
+
+// Separable Sobel: one pass over the three rows gives the vertical sums both
+// gradients share, then gx and gy are differences and sums along the row
+struct SobelSeparable
+{
+    template <int C, int R>
+    static void run(const ImageView &src, const ImageView &dst, SobelNorm norm, bool gray, const ImageView &direction)
+    {
+        const int c = C ? C : src.channels;
+        const int width = src.width;
+        // In gray mode channel 0 alone is differentiated, one entry per pixel
+        const int lanes = gray ? 1 : c;
+        const int n = width * lanes;
+        const bool broadcast = gray && dst.channels != 1;
+#pragma omp parallel
+        {
+            vector<short> smooth(n + 2 * lanes);
+            vector<short> diff(n + 2 * lanes);
+            vector<unsigned char> magnitude(broadcast ? n : 0);
+#pragma omp for
+            for (int y = 0; y < src.height; y++)
+            {
+                const unsigned char *r0 = src.row(y - 1) - c;
+                const unsigned char *r1 = src.row(y) - c;
+                const unsigned char *r2 = src.row(y + 1) - c;
+                if (gray)
+                    sobel_row_sums<C>(r0, r1, r2, c, width + 2, smooth.data(), diff.data());
+                else
+                    sobel_row_sums<1>(r0, r1, r2, 1, n + 2 * c, smooth.data(), diff.data());
+
+                unsigned char *out = dst.row(y);
+                sobel_magnitude(smooth.data(), diff.data(), lanes, n, norm, broadcast ? magnitude.data() : out);
+                if (broadcast)
+                    broadcast_gray<C>(magnitude.data(), src.row(y), out, width, c);
+
+                if (!direction.empty())
+                {
+                    unsigned char *dir = direction.row(y);
+                    for (int x = 0; x < width; x++)
+                    {
+                        const int i = x * lanes;
+                        const int gx = smooth[i + 2 * lanes] - smooth[i];
+                        const int gy = diff[i] + 2 * diff[i + lanes] + diff[i + 2 * lanes];
+                        dir[x] = sobel_direction(gx, gy);
+                    }
+                }
+            }
+        }
+    }
+};
+
+void apply_sobel(const ImageView &src, const ImageView &dst, SobelNorm norm, bool gray, const ImageView &direction,
+                 BorderMode border)
+{
+    gray = gray && src.channels > 1;
+    run_stencil(src, dst, 1, border, [&](const ImageView &in, const ImageView &out) {
+        dispatch_channels<SobelSeparable>(in.channels, in, out, norm, gray, direction);
+    });
+}
+
+void apply_sobel_edge_detection(const ImageView &src, const ImageView &dst, BorderMode border)
+{
+    apply_sobel(src, dst, SOBEL_L2, false, ImageView(), border);
+}
+
+void apply_sobel_edge_detection(const ImageView &img, BorderMode border)
+{
+    apply_sobel_edge_detection(img, img, border);
+}
+
+struct MeanFilter
+{
+    template <int C, int R>
+    static void run(const ImageView &src, const ImageView &dst, int radius)
+    {
+        const int c = C ? C : src.channels;
+        const int r = R ? R : radius;
+        const int taps = 2 * r + 1;
+        const int row_bytes = src.width * c;
+        const int halo = r * c;
+        const int area = taps * taps;
+        // The sum of a 21x21 window of bytes stays far below 2^32 / area
+        const unsigned long long inverse = reciprocal_u32(R ? (2 * R + 1) * (2 * R + 1) : 1);
+#pragma omp parallel
+        {
+            vector<int> vsum(row_bytes + 2 * halo);
+#pragma omp for
+            for (int y = 0; y < src.height; y++)
+            {
+                int *v = vsum.data();
+                fill(vsum.begin(), vsum.end(), 0);
+                for (int k = -r; k <= r; k++)
+                {
+                    const unsigned char *line = src.row(y + k) - halo;
+                    for (int i = 0; i < row_bytes + 2 * halo; i++)
+                    {
+                        v[i] += line[i];
+                    }
+                }
+
+                unsigned char *out = dst.row(y);
+                if (R)
+                {
+                    // Unrolled horizontal window and division by a constant
+                    for (int i = 0; i < row_bytes; i++)
+                    {
+                        unsigned sum = 0;
+                        for (int k = 0; k < taps; k++)
+                        {
+                            sum += v[i + k * c];
+                        }
+                        out[i] = static_cast<unsigned char>((sum * inverse) >> 32);
+                    }
+                    continue;
+                }
+
+                // Sliding horizontal window over the column sums
+                for (int ch = 0; ch < c; ch++)
+                {
+                    int sum = 0;
+                    for (int k = 0; k < taps; k++)
+                    {
+                        sum += v[k * c + ch];
+                    }
+                    for (int x = 0; x < src.width; x++)
+                    {
+                        out[x * c + ch] = static_cast<unsigned char>(sum / area);
+                        if (x + 1 < src.width)
+                        {
+                            sum += v[(x + taps) * c + ch] - v[x * c + ch];
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+void apply_mean_filter(const ImageView &src, const ImageView &dst, int kernel_size, BorderMode border)
+{
+    const int radius = kernel_size / 2;
+    run_stencil(src, dst, radius, border, [&](const ImageView &in, const ImageView &out) {
+        dispatch_stencil<MeanFilter>(in.channels, radius, in, out, radius);
+    });
+}
+
+struct MedianFilter
+{
+    template <int C, int R>
+    static void run(const ImageView &src, const ImageView &dst, int radius)
+    {
+        const int c = C ? C : src.channels;
+        const int r = R ? R : radius;
+        const int taps = 2 * r + 1;
+        const int n = taps * taps;
+#pragma omp parallel
+        {
+            vector<unsigned char> window(n);
+#pragma omp for
+            for (int y = 0; y < src.height; y++)
+            {
+                unsigned char *out = dst.row(y);
+                for (int x = 0; x < src.width; x++)
+                {
+                    for (int ch = 0; ch < c; ch++)
+                    {
+                        unsigned char *w = window.data();
+                        for (int ky = -r; ky <= r; ky++)
+                        {
+                            const unsigned char *line = src.row(y + ky) + (x - r) * c + ch;
+                            for (int kx = 0; kx < taps; kx++)
+                            {
+                                *w++ = line[kx * c];
+                            }
+                        }
+                        nth_element(window.begin(), window.begin() + n / 2, window.end());
+                        out[x * c + ch] = window[n / 2];
+                    }
+                }
+            }
+        }
+    }
+};
+
+void apply_median_filter(const ImageView &src, const ImageView &dst, int kernel_size, BorderMode border)
+{
+    const int radius = kernel_size / 2;
+    run_stencil(src, dst, radius, border, [&](const ImageView &in, const ImageView &out) {
+        dispatch_stencil<MedianFilter>(in.channels, radius, in, out, radius);
+    });
+}
+
+void apply_average(const ImageView &a, const ImageView &b, const ImageView &dst)
+{
+    const int row_bytes = a.row_bytes();
+#pragma omp parallel for
+    for (int y = 0; y < a.height; y++)
+    {
+        const unsigned char *pa = a.row(y);
+        const unsigned char *pb = b.row(y);
+        unsigned char *out = dst.row(y);
+        for (int i = 0; i < row_bytes; i++)
+        {
+            out[i] = static_cast<unsigned char>((pa[i] + pb[i]) >> 1);
+        }
+    }
+}
+
+#if defined(__AVX2__)
+// 16 bytes per step. _mm256_mulhrs_epi16(diff * 64, amount * 512) is the
+// rounded diff * amount, which the scalar tail reproduces exactly.
+static int unsharp_bytes_avx2(const unsigned char *img, const unsigned char *blurred, unsigned char *out, int n,
+                              int scale, int threshold, int channels)
+{
+    const __m256i amount = _mm256_set1_epi16(static_cast<short>(scale));
+    const __m256i below = _mm256_set1_epi16(static_cast<short>(threshold - 1));
+    // Alpha lanes get no correction (16 is a multiple of 2 and 4)
+    __m256i colour = _mm256_set1_epi16(-1);
+    if (channels == 2 || channels == 4)
+    {
+        short lanes[16];
+        for (int j = 0; j < 16; j++)
+            lanes[j] = j % channels == channels - 1 ? 0 : -1;
+        colour = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes));
+    }
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(img + i)));
+        __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blurred + i)));
+        __m256i diff = _mm256_sub_epi16(a, b);
+        __m256i mask = _mm256_and_si256(colour, _mm256_cmpgt_epi16(_mm256_abs_epi16(diff), below));
+        __m256i delta = _mm256_mulhrs_epi16(_mm256_slli_epi16(diff, 6), amount);
+        __m256i sum = _mm256_add_epi16(a, _mm256_and_si256(delta, mask));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_castsi256_si128(packed));
+    }
+    return i;
+}
+#endif
+
+void apply_unsharp_mask(const ImageView &img, const ImageView &blurred, const ImageView &dst, float amount,
+                        int threshold)
+{
+    const int c = img.channels;
+    const int cc = colour_channels(c);
+    const int row_bytes = img.row_bytes();
+    const int scale = min(max(static_cast<int>(lround(amount * 512.0f)), 0), 32767);
+
+#pragma omp parallel for
+    for (int y = 0; y < img.height; y++)
+    {
+        const unsigned char *a = img.row(y);
+        const unsigned char *b = blurred.row(y);
+        unsigned char *out = dst.row(y);
+        int i = 0;
+#if defined(__AVX2__)
+        i = unsharp_bytes_avx2(a, b, out, row_bytes, scale, threshold, c);
+#endif
+        for (; i < row_bytes; i++)
+        {
+            const int diff = a[i] - b[i];
+            if (i % c >= cc || abs(diff) < threshold)
+                out[i] = a[i];
+            else
+                out[i] = clamp_u8(a[i] + ((((diff * 64 * scale) >> 14) + 1) >> 1));
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef IMGPROC_KERNELS_H
+#define IMGPROC_KERNELS_H
+
+#include "gaussian_kernel.h"
+#include "image_view.h"
+#include "padded_image.h"
+#include "point_ops.h"
+
+// Shared image kernels used by the root pipeline and the TryBase tools.
+//
+// Two-argument kernels read `src` and write `dst`; the two views must have the
+// same size and channel count and must not overlap, but may have different
+// strides (e.g. a crop of a larger image written into a packed tile).
+// Single-argument overloads run the same kernel in place, which also works on
+// a roi() of a larger image.
+//
+// Stencil kernels compute every output pixel. Pixels outside `src` are taken
+// from `border`: the default copies the source once into a PaddedImage whose
+// halo is replicated, so the inner loops have no edge branches. Pass
+// BORDER_HALO when `src` is the interior of a PaddedImage or a roi() with
+// valid neighbours to skip that copy.
+
+// Copy pixels between two views of the same size
+void copy_image(const ImageView &src, const ImageView &dst);
+
+// Grayscale conversion (0.3 R + 0.59 G + 0.11 B in fixed point). dst.channels
+// is either 1 (gray plane) or src.channels (gray written to R, G and B, alpha
+// copied). 3 and 4 channel sources use SSSE3 shuffles when built with -mssse3.
+void apply_grayscale(const ImageView &src, const ImageView &dst);
+void apply_grayscale(const ImageView &img);
+
+// 3x3 binomial Gaussian blur
+void apply_gaussian_blur(const ImageView &src, const ImageView &dst, BorderMode border = BORDER_REPLICATE);
+void apply_gaussian_blur(const ImageView &img, BorderMode border = BORDER_REPLICATE);
+
+// Separable Gaussian blur with a (2 * radius + 1) square kernel; the taps come
+// from gaussian_kernel() so repeated calls do no setup
+void apply_gaussian_blur(const ImageView &src, const ImageView &dst, int radius, float sigma,
+                         BorderMode border = BORDER_REPLICATE, KernelPrecision precision = PRECISION_FLOAT);
+void apply_gaussian_blur(const ImageView &img, int radius, float sigma,
+                         BorderMode border = BORDER_REPLICATE, KernelPrecision precision = PRECISION_FLOAT);
+
+// Generic 3x3 convolution, `kernel` is row-major
+void apply_convolution_3x3(const ImageView &src, const ImageView &dst, const float kernel[9], BorderMode border = BORDER_REPLICATE);
+void apply_convolution_3x3(const ImageView &img, const float kernel[9], BorderMode border = BORDER_REPLICATE);
+
+// Sharpening with the {-1 ... 9 ... -1} kernel
+void apply_sharpening(const ImageView &src, const ImageView &dst, BorderMode border = BORDER_REPLICATE);
+void apply_sharpening(const ImageView &img, BorderMode border = BORDER_REPLICATE);
+
+// Sobel edge magnitude per channel, clipped to 255
+void apply_sobel_edge_detection(const ImageView &src, const ImageView &dst, BorderMode border = BORDER_REPLICATE);
+void apply_sobel_edge_detection(const ImageView &img, BorderMode border = BORDER_REPLICATE);
+
+enum SobelNorm
+{
+    SOBEL_L2, // sqrt(gx^2 + gy^2), as apply_sobel_edge_detection
+    SOBEL_L1  // |gx| + |gy|
+};
+
+// Gradient direction quantised to the neighbour pair it points at, in image
+// coordinates (x right, y down)
+enum SobelDirection
+{
+    SOBEL_DIR_0,  // (x - 1, y) and (x + 1, y)
+    SOBEL_DIR_45, // (x - 1, y - 1) and (x + 1, y + 1)
+    SOBEL_DIR_90, // (x, y - 1) and (x, y + 1)
+    SOBEL_DIR_135 // (x + 1, y - 1) and (x - 1, y + 1)
+};
+
+// Sobel magnitude, computed separably from vertical row sums shared by gx and
+// gy (AVX2 when available). With `gray` the source is taken to be gray (R = G
+// = B) and only channel 0 is differentiated; dst is then either a 1-channel
+// plane or has src's layout, the magnitude going to every colour channel.
+// A non-empty `direction` is a 1-channel plane that receives a
+// SobelDirection per pixel, from channel 0's gradient.
+void apply_sobel(const ImageView &src, const ImageView &dst, SobelNorm norm = SOBEL_L2, bool gray = false,
+                 const ImageView &direction = ImageView(), BorderMode border = BORDER_REPLICATE);
+
+// Canny edge detection: grayscale, 5x5 Gaussian (sigma 1), Sobel magnitude
+// (clipped to 255) with direction, non-maximum suppression, and hysteresis
+// between `low` and `high` run in parallel strips that hand edges across their
+// boundaries until nothing changes. dst.channels is either 1 or src.channels;
+// edges are 255 in every colour channel and alpha is copied.
+void apply_canny(const ImageView &src, const ImageView &dst, int low = 40, int high = 100);
+void apply_canny(const ImageView &img, int low = 40, int high = 100);
+
+// Box (mean) filter with a kernel_size x kernel_size window
+void apply_mean_filter(const ImageView &src, const ImageView &dst, int kernel_size, BorderMode border = BORDER_REPLICATE);
+
+// Median filter with a kernel_size x kernel_size window
+void apply_median_filter(const ImageView &src, const ImageView &dst, int kernel_size, BorderMode border = BORDER_REPLICATE);
+
+// Per-pixel average of two images
+void apply_average(const ImageView &a, const ImageView &b, const ImageView &dst);
+
+// Unsharp mask from an already blurred copy of img:
+// out = img + amount * (img - blurred) where |img - blurred| >= threshold,
+// img elsewhere. amount is applied in 1/512 steps (0 to 63). Colour channels
+// only, alpha is copied from img. dst may alias img or blurred.
+void apply_unsharp_mask(const ImageView &img, const ImageView &blurred, const ImageView &dst, float amount,
+                        int threshold = 0);
+
+// Contrast-limited adaptive histogram equalization on a tiles x tiles grid.
+// Tile histograms are clipped at clip_limit times the mean bin count and the
+// tile mappings are blended bilinearly. Colour channels share one mapping.
+void apply_clahe(const ImageView &img, int tiles = 8, float clip_limit = 2.0f);
+
+// Single point ops; chain several with PointOps to fold them into one pass.
+// They touch the colour channels only (alpha is left untouched).
+
+// Histogram equalization over the colour channels
+void apply_histogram_equalization(const ImageView &img);
+
+// out = factor * (in - pivot) + pivot, clamped to [0, 255]
+void apply_contrast_adjustment(const ImageView &src, const ImageView &dst, float factor, int pivot = 128);
+void apply_contrast_adjustment(const ImageView &img, float factor, int pivot = 128);
+
+// out = in + offset, clamped to [0, 255]
+void apply_brightness_correction(const ImageView &src, const ImageView &dst, int offset);
+void apply_brightness_correction(const ImageView &img, int offset);
+
+#endif
@@ -0,0 +1,158 @@
+#include "lazy.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+ImageView LazyImage::run() const
+{
+    Pipeline optimised = pipeline;
+    optimise_pipeline(optimised);
+    return optimised.run(source);
+}
+
+string LazyImage::plan() const
+{
+    Pipeline optimised = pipeline;
+    optimise_pipeline(optimised);
+    return optimised.describe();
+}
+
+Branch LazyImage::into(const ImageView &output) const
+{
+    Branch branch = {pipeline, output};
+    optimise_pipeline(branch.pipeline);
+    return branch;
+}
+
+LazyImage operator|(const ImageView &img, const Stage &stage)
+{
+    LazyImage lazy;
+    lazy.source = img;
+    lazy.pipeline.stages.push_back(stage);
+    return lazy;
+}
+
+LazyImage operator|(LazyImage lazy, const Stage &stage)
+{
+    lazy.pipeline.stages.push_back(stage);
+    return lazy;
+}
+
+namespace ops
+{
+static Stage make_stage(StageKind kind, int size = 0, float param = 0.0f)
+{
+    return {kind, size, param, PointOps(), {}};
+}
+
+// Arguments are held to the text form's rules (parse_stage). A stage built
+// in code with anything else is a bug, so stop rather than run a stage that
+// does nothing or fails later inside its kernel.
+static void check(bool ok, const char *op, const char *rule)
+{
+    if (!ok)
+    {
+        cerr << "ops::" << op << ": " << rule << endl;
+        abort();
+    }
+}
+
+// Windows: odd and at least 3
+static int checked_size(const char *op, int size)
+{
+    check(size >= 3 && size % 2 == 1, op, "size must be odd and at least 3");
+    return size;
+}
+
+Stage gray()
+{
+    return make_stage(STAGE_GRAY);
+}
+
+Stage crop_lesion(float margin)
+{
+    check(margin >= 0.0f, "crop_lesion", "margin must not be negative");
+    return make_stage(STAGE_CROP_LESION, 0, margin);
+}
+
+Stage blur(int size, float sigma)
+{
+    check(sigma >= 0.0f, "blur", "sigma must not be negative (0 picks one for the size)");
+    return make_stage(STAGE_BLUR, checked_size("blur", size), sigma);
+}
+
+Stage sharpen()
+{
+    return make_stage(STAGE_SHARPEN);
+}
+
+Stage unsharp(float amount, int threshold, int size, float sigma)
+{
+    check(amount >= 0.0f && amount < 64.0f, "unsharp", "amount must be in [0, 64)");
+    check(threshold >= 0 && threshold <= 255, "unsharp", "threshold must be in 0..255");
+    check(sigma >= 0.0f, "unsharp", "sigma must not be negative (0 picks one for the size)");
+    Stage stage = make_stage(STAGE_UNSHARP, checked_size("unsharp", size), sigma);
+    stage.amount = amount;
+    stage.threshold = threshold;
+    return stage;
+}
+
+Stage sobel(SobelNorm norm)
+{
+    return make_stage(STAGE_SOBEL, norm);
+}
+
+Stage canny(int low, int high)
+{
+    check(low >= 0 && low <= high && high <= 255, "canny", "thresholds must satisfy 0 <= low <= high <= 255");
+    return make_stage(STAGE_CANNY, low, static_cast<float>(high));
+}
+
+Stage convolve(const float kernel[9])
+{
+    Stage stage = make_stage(STAGE_CONVOLUTION);
+    stage.kernel.assign(kernel, kernel + 9);
+    return stage;
+}
+
+Stage mean(int size)
+{
+    return make_stage(STAGE_MEAN, checked_size("mean", size));
+}
+
+Stage median(int size)
+{
+    return make_stage(STAGE_MEDIAN, checked_size("median", size));
+}
+
+Stage clahe(int tiles, float clip_limit)
+{
+    check(tiles >= 1, "clahe", "tiles must be at least 1");
+    check(clip_limit > 0.0f, "clahe", "clip limit must be positive");
+    return make_stage(STAGE_CLAHE, tiles, clip_limit);
+}
+
+Stage equalize()
+{
+    return point(PointOps().equalize());
+}
+
+Stage brightness(int offset)
+{
+    return point(PointOps().brightness(offset));
+}
+
+Stage contrast(float factor, int pivot)
+{
+    return point(PointOps().contrast(factor, pivot));
+}
+
+Stage point(const PointOps &point)
+{
+    Stage stage = make_stage(STAGE_POINT);
+    stage.point = point;
+    return stage;
+}
+}
@@ -0,0 +1,55 @@
+#ifndef IMGPROC_LAZY_H
+#define IMGPROC_LAZY_H
+
+#include "image_view.h"
+#include "kernels.h"
+#include "pipeline.h"
+
+#include <string>
+
+// Expression form of a Pipeline:
+//
+//     using namespace ops;
+//     ImageView result = (view | gray() | blur(3) | sharpen() | equalize()).run();
+//
+// `|` only records the stage. run() optimises the chain and executes it in
+// place, grouping stencils and point ops into tiled passes (see
+// Pipeline::run); plan() shows those passes without touching the pixels.
+struct LazyImage
+{
+    ImageView source;
+    Pipeline pipeline;
+
+    ImageView run() const;
+    std::string plan() const;
+
+    // The optimised stages as one branch of run_fanout(), writing to `output`
+    Branch into(const ImageView &output) const;
+};
+
+LazyImage operator|(const ImageView &img, const Stage &stage);
+LazyImage operator|(LazyImage lazy, const Stage &stage);
+
+// Stage constructors, one per pipeline operator (same defaults as the text
+// form). Arguments the text form would reject (an even window, canny's low
+// above high, no clahe tiles, ...) abort with a message.
+namespace ops
+{
+Stage gray();
+Stage crop_lesion(float margin = 0.1f);
+Stage blur(int size = 3, float sigma = 0.0f);
+Stage sharpen();
+Stage unsharp(float amount = 1.0f, int threshold = 0, int size = 3, float sigma = 0.0f);
+Stage sobel(SobelNorm norm = SOBEL_L2);
+Stage canny(int low = 40, int high = 100);
+Stage convolve(const float kernel[9]);
+Stage mean(int size);
+Stage median(int size);
+Stage clahe(int tiles = 8, float clip_limit = 2.0f);
+Stage equalize();
+Stage brightness(int offset);
+Stage contrast(float factor, int pivot = 128);
+Stage point(const PointOps &point);
+}
+
+#endif
@@ -0,0 +1,336 @@
+#include "loader.h"
+#include "geometry.h"
+#include "point_ops.h"
+#include "../stb_image.h"
+
+#include <omp.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct Sample
+{
+    string path;
+    int label;
+};
+
+// One batch buffer of the ring; batch b lives in slot b % prefetch
+struct Slot
+{
+    long long batch = -1;
+    bool ready = false;
+    int count = 0;
+    vector<unsigned char> images;
+    vector<int> labels;
+};
+
+struct Loader
+{
+    LoaderOptions options;
+    vector<string> classes;
+    vector<Sample> samples;
+    int batches_per_epoch = 0;
+
+    mutex lock;
+    condition_variable slot_free;
+    condition_variable batch_ready;
+    vector<Slot> slots;
+    long long next_batch = 0; // next batch a worker claims
+    long long consumed = 0;   // batches handed to the caller
+    bool stopping = false;
+    map<long long, shared_ptr<const vector<int>>> orders; // sample order of recent epochs
+
+    vector<thread> workers;
+};
+
+static bool is_image_file(const string &name)
+{
+    const size_t dot = name.rfind('.');
+    if (dot == string::npos)
+        return false;
+    string extension = name.substr(dot + 1);
+    for (char &ch : extension)
+        ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    return extension == "jpg" || extension == "jpeg" || extension == "png" || extension == "bmp";
+}
+
+// Sorted names of the subdirectories (or image files) of `path`
+static vector<string> list_directory(const string &path, bool directories)
+{
+    vector<string> names;
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return names;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        struct stat info;
+        if (stat((path + "/" + name).c_str(), &info) != 0)
+            continue;
+        if (directories ? S_ISDIR(info.st_mode) : (S_ISREG(info.st_mode) && is_image_file(name)))
+            names.push_back(name);
+    }
+    closedir(dir);
+    sort(names.begin(), names.end());
+    return names;
+}
+
+// Sample order of an epoch, shared by the workers of that epoch. Called with
+// the lock held; epochs two behind are dropped (workers keep their copy alive).
+static shared_ptr<const vector<int>> epoch_order(Loader &loader, long long epoch)
+{
+    auto found = loader.orders.find(epoch);
+    if (found != loader.orders.end())
+        return found->second;
+
+    auto order = make_shared<vector<int>>(loader.samples.size());
+    iota(order->begin(), order->end(), 0);
+    if (loader.options.shuffle)
+    {
+        seed_seq seq = {loader.options.seed, static_cast<unsigned>(epoch >> 32), static_cast<unsigned>(epoch)};
+        mt19937 rng(seq);
+        shuffle(order->begin(), order->end(), rng);
+    }
+    loader.orders.erase(loader.orders.begin(), loader.orders.lower_bound(epoch - 1));
+    loader.orders[epoch] = order;
+    return order;
+}
+
+// Decode, warp to size x size and augment one image into `out`. Every random
+// number is drawn whether or not its augmentation is enabled, so enabling one
+// does not change the others. False (and `out` untouched) if the image cannot
+// be decoded.
+static bool load_sample(const LoaderOptions &options, const Sample &sample, mt19937 &rng, unsigned char *out,
+                        vector<unsigned char> &scratch)
+{
+    const int size = options.size;
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const bool flip_h = unit(rng) < 0.5f;
+    const bool flip_v = unit(rng) < 0.5f;
+    const int turns = static_cast<int>(unit(rng) * 4.0f) & 3;
+    const float angle = (2.0f * unit(rng) - 1.0f) * options.max_rotation;
+    const float zoom = options.min_scale + unit(rng) * (options.max_scale - options.min_scale);
+    const int offset = static_cast<int>(lround((2.0f * unit(rng) - 1.0f) * options.max_brightness));
+    const float factor = 1.0f + (2.0f * unit(rng) - 1.0f) * options.max_contrast;
+
+    int width, height, channels;
+    unsigned char *img = stbi_load(sample.path.c_str(), &width, &height, &channels, 3);
+    if (img == nullptr)
+    {
+        cerr << "Skipping image: " << sample.path << " (" << stbi_failure_reason() << ")" << endl;
+        return false;
+    }
+
+    // Output pixel centre -> rotate by -angle about the centre, shrink by the
+    // zoom, stretch to the source size -> source pixel centre
+    const float radians = angle * static_cast<float>(M_PI) / 180.0f;
+    const float cos_a = cos(radians) / zoom, sin_a = sin(radians) / zoom;
+    const float sx = static_cast<float>(width) / size, sy = static_cast<float>(height) / size;
+    const float centre = 0.5f - size / 2.0f;
+    float m[6];
+    m[0] = cos_a * sx;
+    m[1] = sin_a * sx;
+    m[2] = centre * (m[0] + m[1]) + width / 2.0f - 0.5f;
+    m[3] = -sin_a * sy;
+    m[4] = cos_a * sy;
+    m[5] = centre * (m[3] + m[4]) + height / 2.0f - 0.5f;
+
+    const ImageView source(img, width, height, 3);
+    const ImageView view(out, size, size, 3);
+    const bool quarter = options.quarter_turns && (turns & 1);
+    apply_affine(source, quarter ? ImageView(scratch.data(), size, size, 3) : view, m);
+    stbi_image_free(img);
+
+    if (quarter)
+        apply_rotation(ImageView(scratch.data(), size, size, 3), view, turns == 1 ? ROTATE_90 : ROTATE_270);
+    else if (options.quarter_turns && turns == 2)
+        apply_rotation(view, view, ROTATE_180);
+    if (options.flip_horizontal && flip_h)
+        apply_flip_horizontal(view);
+    if (options.flip_vertical && flip_v)
+        apply_flip_vertical(view);
+    if (offset != 0 || factor != 1.0f)
+        PointOps().contrast(factor).brightness(offset).apply(view);
+    return true;
+}
+
+static int batch_count(const Loader &loader, long long batch)
+{
+    const long long first = (batch % loader.batches_per_epoch) * loader.options.batch_size;
+    return static_cast<int>(min<long long>(loader.options.batch_size, loader.samples.size() - first));
+}
+
+static void worker(Loader *loader)
+{
+    // Parallelism comes from the workers; the kernels run single-threaded
+    omp_set_num_threads(1);
+    const LoaderOptions &options = loader->options;
+    const size_t image_bytes = static_cast<size_t>(options.size) * options.size * 3;
+    vector<unsigned char> scratch(image_bytes);
+
+    while (true)
+    {
+        unique_lock<mutex> guard(loader->lock);
+        loader->slot_free.wait(guard, [&] {
+            return loader->stopping || loader->next_batch < loader->consumed + options.prefetch;
+        });
+        if (loader->stopping)
+            return;
+        const long long batch = loader->next_batch++;
+        const shared_ptr<const vector<int>> order = epoch_order(*loader, batch / loader->batches_per_epoch);
+        Slot &slot = loader->slots[batch % options.prefetch];
+        guard.unlock();
+
+        // The slot is ours: the batch that used it before has been consumed.
+        // Samples that fail to decode are left out, never sent as blank images.
+        const int count = batch_count(*loader, batch);
+        const long long first = (batch % loader->batches_per_epoch) * options.batch_size;
+        int loaded = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const Sample &sample = loader->samples[(*order)[first + i]];
+            seed_seq seq = {options.seed, static_cast<unsigned>(batch >> 32), static_cast<unsigned>(batch),
+                            static_cast<unsigned>(i)};
+            mt19937 rng(seq);
+            if (load_sample(options, sample, rng, slot.images.data() + loaded * image_bytes, scratch))
+                slot.labels[loaded++] = sample.label;
+        }
+
+        guard.lock();
+        slot.batch = batch;
+        slot.count = loaded;
+        slot.ready = true;
+        loader->batch_ready.notify_all();
+    }
+}
+
+void loader_default_options(LoaderOptions *options)
+{
+    options->batch_size = 16;
+    options->size = 224;
+    options->workers = 4;
+    options->prefetch = 8;
+    options->shuffle = 1;
+    options->seed = 0;
+    options->flip_horizontal = 1;
+    options->flip_vertical = 1;
+    options->quarter_turns = 1;
+    options->max_rotation = 15.0f;
+    options->min_scale = 0.9f;
+    options->max_scale = 1.1f;
+    options->max_brightness = 20;
+    options->max_contrast = 0.2f;
+}
+
+Loader *loader_open(const char *root, const LoaderOptions *options)
+{
+    if (options->batch_size < 1 || options->size < 1 || options->workers < 1 || options->prefetch < 1 ||
+        options->min_scale <= 0.0f || options->max_scale < options->min_scale)
+    {
+        cerr << "Invalid loader options" << endl;
+        return nullptr;
+    }
+
+    Loader *loader = new Loader();
+    loader->options = *options;
+    loader->classes = list_directory(root, true);
+    for (size_t label = 0; label < loader->classes.size(); label++)
+    {
+        const string folder = string(root) + "/" + loader->classes[label];
+        for (const string &name : list_directory(folder, false))
+            loader->samples.push_back({folder + "/" + name, static_cast<int>(label)});
+    }
+    if (loader->samples.empty())
+    {
+        cerr << "No images found under " << root << endl;
+        delete loader;
+        return nullptr;
+    }
+
+    const int samples = static_cast<int>(loader->samples.size());
+    loader->batches_per_epoch = (samples + options->batch_size - 1) / options->batch_size;
+    loader->slots.resize(options->prefetch);
+    for (Slot &slot : loader->slots)
+    {
+        slot.images.resize(static_cast<size_t>(options->batch_size) * options->size * options->size * 3);
+        slot.labels.resize(options->batch_size);
+    }
+    for (int i = 0; i < options->workers; i++)
+        loader->workers.emplace_back(worker, loader);
+    return loader;
+}
+
+void loader_close(Loader *loader)
+{
+    if (loader == nullptr)
+        return;
+    {
+        lock_guard<mutex> guard(loader->lock);
+        loader->stopping = true;
+    }
+    loader->slot_free.notify_all();
+    for (thread &t : loader->workers)
+        t.join();
+    delete loader;
+}
+
+int loader_samples(const Loader *loader)
+{
+    return static_cast<int>(loader->samples.size());
+}
+
+int loader_batches_per_epoch(const Loader *loader)
+{
+    return loader->batches_per_epoch;
+}
+
+int loader_classes(const Loader *loader)
+{
+    return static_cast<int>(loader->classes.size());
+}
+
+const char *loader_class_name(const Loader *loader, int label)
+{
+    if (label < 0 || label >= static_cast<int>(loader->classes.size()))
+        return nullptr;
+    return loader->classes[label].c_str();
+}
+
+int loader_next(Loader *loader, unsigned char *images, int *labels)
+{
+    unique_lock<mutex> guard(loader->lock);
+    const long long batch = loader->consumed;
+    Slot &slot = loader->slots[batch % loader->options.prefetch];
+    loader->batch_ready.wait(guard, [&] { return slot.ready && slot.batch == batch; });
+    guard.unlock();
+
+    // Workers leave the slot alone until `consumed` moves past it
+    const int count = slot.count;
+    memcpy(images, slot.images.data(), static_cast<size_t>(count) * loader->options.size * loader->options.size * 3);
+    memcpy(labels, slot.labels.data(), count * sizeof(int));
+
+    guard.lock();
+    slot.ready = false;
+    loader->consumed++;
+    guard.unlock();
+    loader->slot_free.notify_all();
+    return count;
+}
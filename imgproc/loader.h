@@ -0,0 +1,69 @@
+#ifndef IMGPROC_LOADER_H
+#define IMGPROC_LOADER_H
+
+// Training data loader: shuffled, augmented batches decoded by a pool of
+// worker threads that run ahead of the consumer.
+//
+// The dataset root has one subdirectory per class (like Keras'
+// flow_from_directory); classes are numbered in sorted name order. Every
+// image is decoded as RGB, then a single bilinear warp resizes it to
+// size x size with a random rotation and zoom, followed by random flips and
+// quarter turns (imgproc/geometry.h) and a brightness / contrast LUT.
+//
+// Batches come out in a fixed order for a given seed whatever the number of
+// workers: the shuffle of each epoch and the augmentation of each sample are
+// drawn from seeds derived from (seed, epoch, position).
+//
+// Plain C interface so Python can load the library with ctypes (see
+// Classifier/loader.py).
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct LoaderOptions
+    {
+        int batch_size;      // images per batch (the last batch of an epoch may be smaller)
+        int size;            // output width and height
+        int workers;         // decoding threads
+        int prefetch;        // batches decoded ahead of the consumer
+        int shuffle;         // reshuffle every epoch
+        unsigned seed;       // shuffle and augmentation seed
+        int flip_horizontal; // mirror with probability 1/2
+        int flip_vertical;   // mirror with probability 1/2
+        int quarter_turns;   // rotate by a random multiple of 90 degrees
+        float max_rotation;  // plus a rotation uniform in [-max, max] degrees
+        float min_scale;     // zoom factor uniform in [min, max]
+        float max_scale;
+        int max_brightness;  // offset uniform in [-max, max]
+        float max_contrast;  // contrast factor uniform in [1 - max, 1 + max]
+    };
+
+    struct Loader;
+
+    // Defaults: 16 x 224 x 224, 4 workers, 8 batches ahead, every augmentation on
+    void loader_default_options(struct LoaderOptions *options);
+
+    // Returns NULL (and prints why) for invalid options or a root without images
+    struct Loader *loader_open(const char *root, const struct LoaderOptions *options);
+    void loader_close(struct Loader *loader);
+
+    int loader_samples(const struct Loader *loader);
+    int loader_batches_per_epoch(const struct Loader *loader);
+    int loader_classes(const struct Loader *loader);
+    const char *loader_class_name(const struct Loader *loader, int label);
+
+    // Block until the next batch is ready and copy it out: `images` receives
+    // batch_size x size x size x 3 bytes (RGB, row-major), `labels` batch_size
+    // ints. Returns the number of images in the batch, which is short of
+    // batch_size by the images that could not be decoded (printed on stderr
+    // and left out, never sent blank) and may be 0. Epochs follow each other
+    // without end; loader_batches_per_epoch() tells where one stops.
+    int loader_next(struct Loader *loader, unsigned char *images, int *labels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+#include "padded_image.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// Source index for position i of an n-pixel line extended with `border`
+static int border_index(int i, int n, BorderMode border)
+{
+    if (border != BORDER_REFLECT || n == 1)
+        return min(max(i, 0), n - 1);
+
+    int period = 2 * (n - 1);
+    i %= period;
+    if (i < 0)
+        i += period;
+    return i < n ? i : period - i;
+}
+
+PaddedImage::PaddedImage(int width, int height, int channels, int pad) : pad(pad)
+{
+    // Round rows up to 16 bytes so every row starts on a vector boundary
+    int stride = ((width + 2 * pad) * channels + 15) & ~15;
+    buffer.resize(static_cast<size_t>(stride) * (height + 2 * pad));
+    padded = ImageView(buffer.data(), width + 2 * pad, height + 2 * pad, channels, stride);
+}
+
+PaddedImage::PaddedImage(const ImageView &src, int pad, BorderMode border, unsigned char value)
+    : PaddedImage(src.width, src.height, src.channels, pad)
+{
+    if (border == BORDER_HALO)
+    {
+        copy_image(src.roi(-pad, -pad, src.width + 2 * pad, src.height + 2 * pad), padded);
+        return;
+    }
+    copy_image(src, view());
+    fill_border(border, value);
+}
+
+void PaddedImage::fill_border(BorderMode border, unsigned char value)
+{
+    if (border == BORDER_HALO || pad == 0)
+        return;
+
+    const ImageView inner = view();
+    const int c = inner.channels;
+    const int w = inner.width;
+    const int h = inner.height;
+
+    if (border == BORDER_CONSTANT)
+    {
+        for (int y = -pad; y < h + pad; y++)
+        {
+            if (y < 0 || y >= h)
+            {
+                memset(inner.row(y) - pad * c, value, padded.row_bytes());
+                continue;
+            }
+            memset(inner.row(y) - pad * c, value, pad * c);
+            memset(inner.row(y) + w * c, value, pad * c);
+        }
+        return;
+    }
+
+    // Left and right halo of every interior row, then whole halo rows above and below
+    for (int y = 0; y < h; y++)
+    {
+        unsigned char *row = inner.row(y);
+        for (int p = 1; p <= pad; p++)
+        {
+            memcpy(row - p * c, row + border_index(-p, w, border) * c, c);
+            memcpy(row + (w - 1 + p) * c, row + border_index(w - 1 + p, w, border) * c, c);
+        }
+    }
+    for (int p = 1; p <= pad; p++)
+    {
+        memcpy(inner.row(-p) - pad * c, inner.row(border_index(-p, h, border)) - pad * c, padded.row_bytes());
+        memcpy(inner.row(h - 1 + p) - pad * c, inner.row(border_index(h - 1 + p, h, border)) - pad * c, padded.row_bytes());
+    }
+}
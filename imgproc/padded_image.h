@@ -0,0 +1,45 @@
+#ifndef IMGPROC_PADDED_IMAGE_H
+#define IMGPROC_PADDED_IMAGE_H
+
+#include "image_view.h"
+
+#include <vector>
+
+// How a stencil sees pixels outside the image
+enum BorderMode
+{
+    BORDER_REPLICATE, // aaa|abcd|ddd
+    BORDER_REFLECT,   // dcb|abcd|cba (mirror around the edge pixel)
+    BORDER_CONSTANT,  // 000|abcd|000
+    BORDER_HALO       // the pixels around the view are valid already (padded buffer or roi() of a larger image)
+};
+
+// Owning image with a `pad`-pixel halo on every side.
+// view() is the interior; its stride covers the halo, so a stencil of radius
+// <= pad can read (x - pad .. x + pad) for every interior pixel without branches.
+struct PaddedImage
+{
+    std::vector<unsigned char> buffer;
+    ImageView padded; // whole buffer, halo included
+    int pad;
+
+    PaddedImage(int width, int height, int channels, int pad);
+
+    // Copy `src` into the interior and fill the halo according to `border`
+    PaddedImage(const ImageView &src, int pad, BorderMode border, unsigned char value = 0);
+
+    PaddedImage(const PaddedImage &) = delete;
+    PaddedImage &operator=(const PaddedImage &) = delete;
+    PaddedImage(PaddedImage &&) = default;
+    PaddedImage &operator=(PaddedImage &&) = default;
+
+    ImageView view() const
+    {
+        return padded.roi(pad, pad, padded.width - 2 * pad, padded.height - 2 * pad);
+    }
+
+    // Recompute the halo from the interior (BORDER_HALO leaves it untouched)
+    void fill_border(BorderMode border, unsigned char value = 0);
+};
+
+#endif
@@ -0,0 +1,877 @@
+#include "pipeline.h"
+#include "kernels.h"
+#include "roi.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+static string trim(const string &s)
+{
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == string::npos)
+        return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+static bool parse_int(const string &s, int &value)
+{
+    char *end;
+    long v = strtol(s.c_str(), &end, 10);
+    if (s.empty() || *end != '\0')
+        return false;
+    value = static_cast<int>(v);
+    return true;
+}
+
+static bool parse_float(const string &s, float &value)
+{
+    char *end;
+    float v = strtof(s.c_str(), &end);
+    if (s.empty() || *end != '\0')
+        return false;
+    value = v;
+    return true;
+}
+
+// Parse one "name[:arg[:arg]]" entry
+static bool parse_stage(const string &entry, Stage &stage, string &error)
+{
+    vector<string> parts;
+    stringstream ss(entry);
+    string part;
+    while (getline(ss, part, ':'))
+    {
+        parts.push_back(trim(part));
+    }
+    const string &name = parts[0];
+    const size_t args = parts.size() - 1;
+
+    stage = {STAGE_POINT, 0, 0.0f, PointOps(), {}};
+    bool ok = true;
+    size_t max_args = 0;
+
+    if (name == "gray" || name == "grayscale")
+    {
+        stage.kind = STAGE_GRAY;
+    }
+    else if (name == "crop-lesion")
+    {
+        stage.kind = STAGE_CROP_LESION;
+        stage.param = 0.1f;
+        max_args = 1;
+        if (args >= 1)
+            ok = parse_float(parts[1], stage.param) && stage.param >= 0.0f;
+    }
+    else if (name == "blur")
+    {
+        stage.kind = STAGE_BLUR;
+        stage.size = 3;
+        max_args = 2;
+        if (args >= 1)
+            ok = parse_int(parts[1], stage.size) && stage.size >= 3 && stage.size % 2 == 1;
+        if (ok && args >= 2)
+            ok = parse_float(parts[2], stage.param) && stage.param > 0.0f;
+    }
+    else if (name == "sharpen")
+    {
+        stage.kind = STAGE_SHARPEN;
+    }
+    else if (name == "unsharp")
+    {
+        stage.kind = STAGE_UNSHARP;
+        stage.size = 3;
+        max_args = 4;
+        if (args >= 1)
+            ok = parse_float(parts[1], stage.amount) && stage.amount >= 0.0f && stage.amount < 64.0f;
+        if (ok && args >= 2)
+            ok = parse_int(parts[2], stage.threshold) && stage.threshold >= 0 && stage.threshold <= 255;
+        if (ok && args >= 3)
+            ok = parse_int(parts[3], stage.size) && stage.size >= 3 && stage.size % 2 == 1;
+        if (ok && args >= 4)
+            ok = parse_float(parts[4], stage.param) && stage.param > 0.0f;
+    }
+    else if (name == "sobel")
+    {
+        stage.kind = STAGE_SOBEL;
+        stage.size = SOBEL_L2;
+        max_args = 1;
+        if (args >= 1)
+        {
+            ok = parts[1] == "l1" || parts[1] == "l2";
+            stage.size = parts[1] == "l1" ? SOBEL_L1 : SOBEL_L2;
+        }
+    }
+    else if (name == "canny")
+    {
+        stage.kind = STAGE_CANNY;
+        stage.size = 40;
+        max_args = 2;
+        int high = 100;
+        if (args >= 1)
+            ok = parse_int(parts[1], stage.size) && stage.size >= 0 && stage.size <= 255;
+        if (ok && args >= 2)
+            ok = parse_int(parts[2], high) && high >= stage.size && high <= 255;
+        stage.param = static_cast<float>(high);
+    }
+    else if (name == "conv")
+    {
+        stage.kind = STAGE_CONVOLUTION;
+        stage.kernel.resize(9);
+        max_args = 9;
+        ok = args == 9;
+        for (size_t i = 0; ok && i < 9; i++)
+            ok = parse_float(parts[i + 1], stage.kernel[i]);
+    }
+    else if (name == "mean" || name == "median")
+    {
+        stage.kind = name == "mean" ? STAGE_MEAN : STAGE_MEDIAN;
+        stage.size = 3;
+        max_args = 1;
+        if (args >= 1)
+            ok = parse_int(parts[1], stage.size) && stage.size >= 3 && stage.size % 2 == 1;
+    }
+    else if (name == "clahe")
+    {
+        stage.kind = STAGE_CLAHE;
+        stage.size = 8;
+        stage.param = 2.0f;
+        max_args = 2;
+        if (args >= 1)
+            ok = parse_int(parts[1], stage.size) && stage.size >= 1;
+        if (ok && args >= 2)
+            ok = parse_float(parts[2], stage.param) && stage.param > 0.0f;
+    }
+    else if (name == "equalize")
+    {
+        stage.point.equalize();
+    }
+    else if (name == "brightness")
+    {
+        int offset = 0;
+        max_args = 1;
+        ok = args == 1 && parse_int(parts[1], offset);
+        stage.point.brightness(offset);
+    }
+    else if (name == "contrast")
+    {
+        float factor = 1.0f;
+        int pivot = 128;
+        max_args = 2;
+        ok = args >= 1 && parse_float(parts[1], factor);
+        if (ok && args >= 2)
+            ok = parse_int(parts[2], pivot);
+        stage.point.contrast(factor, pivot);
+    }
+    else
+    {
+        error = "unknown operator '" + name + "'";
+        return false;
+    }
+
+    if (!ok || args > max_args)
+    {
+        error = "bad arguments in '" + entry + "'";
+        return false;
+    }
+    return true;
+}
+
+bool parse_pipeline(const string &spec, Pipeline &pipeline, string &error)
+{
+    pipeline.stages.clear();
+
+    stringstream lines(spec);
+    string line;
+    while (getline(lines, line))
+    {
+        line = line.substr(0, line.find('#'));
+        stringstream entries(line);
+        string entry;
+        while (getline(entries, entry, ','))
+        {
+            entry = trim(entry);
+            if (entry.empty())
+                continue;
+            Stage stage;
+            if (!parse_stage(entry, stage, error))
+                return false;
+            pipeline.stages.push_back(stage);
+        }
+    }
+
+    if (pipeline.stages.empty())
+    {
+        error = "empty pipeline";
+        return false;
+    }
+    optimise_pipeline(pipeline);
+    return true;
+}
+
+bool load_pipeline(const string &path, Pipeline &pipeline, string &error)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    stringstream contents;
+    contents << file.rdbuf();
+    return parse_pipeline(contents.str(), pipeline, error);
+}
+
+// Non-decreasing maps that need no histogram commute with the median filter:
+// median(f(x)) == f(median(x))
+static bool commutes_with_median(const PointOps &point)
+{
+    for (const PointOps::Op &op : point.ops)
+    {
+        if (op.kind == PointOps::EQUALIZE)
+            return false;
+        if (op.kind == PointOps::CONTRAST && op.factor < 0.0f)
+            return false;
+        if (op.kind == PointOps::TABLE)
+        {
+            for (int i = 1; i < 256; i++)
+            {
+                if (op.table[i] < op.table[i - 1])
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+void optimise_pipeline(Pipeline &pipeline)
+{
+    vector<Stage> &stages = pipeline.stages;
+
+    // Move point groups forward across medians when another point group
+    // follows, so the two fuse into one LUT pass
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        if (stages[i].kind != STAGE_POINT || !commutes_with_median(stages[i].point))
+            continue;
+        size_t j = i + 1;
+        while (j < stages.size() && stages[j].kind == STAGE_MEDIAN)
+            j++;
+        if (j > i + 1 && j < stages.size() && stages[j].kind == STAGE_POINT)
+        {
+            Stage moved = stages[i];
+            stages.erase(stages.begin() + i);
+            stages.insert(stages.begin() + (j - 1), moved);
+        }
+    }
+
+    // Fuse neighbouring point groups. Every stage treats the channels alike,
+    // so once the image is gray any later grayscale conversion is a no-op.
+    vector<Stage> fused;
+    bool gray = false;
+    for (const Stage &stage : stages)
+    {
+        if (stage.kind == STAGE_GRAY)
+        {
+            if (!gray)
+                fused.push_back(stage);
+            gray = true;
+            continue;
+        }
+        if (!fused.empty() && fused.back().kind == STAGE_POINT && stage.kind == STAGE_POINT)
+        {
+            for (const PointOps::Op &op : stage.point.ops)
+                fused.back().point.ops.push_back(op);
+            continue;
+        }
+        fused.push_back(stage);
+    }
+    stages = fused;
+}
+
+static int stencil_radius(const Stage &stage)
+{
+    switch (stage.kind)
+    {
+    case STAGE_BLUR:
+    case STAGE_UNSHARP:
+    case STAGE_MEAN:
+    case STAGE_MEDIAN:
+        return stage.size / 2;
+    case STAGE_SHARPEN:
+    case STAGE_SOBEL:
+    case STAGE_CONVOLUTION:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static bool needs_histogram(const Stage &stage)
+{
+    return stage.kind == STAGE_POINT && stage.point.needs_histogram();
+}
+
+// Stages that work on a strip of rows given enough halo rows around it
+static bool is_tileable(const Stage &stage)
+{
+    return stage.kind == STAGE_GRAY || stencil_radius(stage) > 0 || (stage.kind == STAGE_POINT && !needs_histogram(stage));
+}
+
+// Consecutive stages executed in one traversal of the image
+struct Pass
+{
+    size_t first;
+    size_t last;    // one past the final stage
+    bool tiled;     // run strip by strip through cache-sized buffers
+    bool histogram; // gather the output histogram for the equalize that follows
+    int halo;       // rows of input needed above and below a strip
+};
+
+// `histogram_ready`: an equalize at the very start can use a histogram the
+// caller computes up front
+static vector<Pass> plan_passes(const vector<Stage> &stages, bool histogram_ready = false)
+{
+    vector<Pass> passes;
+    bool have_histogram = histogram_ready;
+    size_t i = 0;
+    while (i < stages.size())
+    {
+        // An equalize whose histogram the previous pass gathered is a plain LUT
+        size_t j = i;
+        if (have_histogram && needs_histogram(stages[j]))
+            j++;
+        while (j < stages.size() && is_tileable(stages[j]))
+            j++;
+
+        Pass pass = {i, j, false, false, 0};
+        if (j == i)
+        {
+            pass.last = i + 1;
+        }
+        else
+        {
+            for (size_t k = i; k < j; k++)
+                pass.halo += stencil_radius(stages[k]);
+            pass.histogram = j < stages.size() && needs_histogram(stages[j]);
+            pass.tiled = j - i > 1 || pass.halo > 0 || pass.histogram;
+        }
+        have_histogram = pass.histogram;
+        passes.push_back(pass);
+        i = pass.last;
+    }
+    return passes;
+}
+
+// Every stage treats the channels alike, so after a grayscale stage R = G = B
+static bool gray_before(const vector<Stage> &stages, size_t k)
+{
+    for (size_t i = 0; i < k; i++)
+    {
+        if (stages[i].kind == STAGE_GRAY)
+            return true;
+    }
+    return false;
+}
+
+// One stencil stage from `src` (valid halo around it) into `dst`. `gray`
+// says the image is known to be gray, so Sobel differentiates one channel.
+static void run_stencil_stage(const Stage &stage, const ImageView &src, const ImageView &dst, bool gray)
+{
+    switch (stage.kind)
+    {
+    case STAGE_BLUR:
+    case STAGE_UNSHARP:
+        if (stage.size == 3 && stage.param == 0.0f)
+        {
+            apply_gaussian_blur(src, dst, BORDER_HALO);
+        }
+        else
+        {
+            const int radius = stage.size / 2;
+            apply_gaussian_blur(src, dst, radius, stage.param > 0.0f ? stage.param : radius / 2.0f, BORDER_HALO);
+        }
+        // The blurred strip is the mask; sharpening is a point op over both buffers
+        if (stage.kind == STAGE_UNSHARP)
+            apply_unsharp_mask(src, dst, dst, stage.amount, stage.threshold);
+        break;
+    case STAGE_SHARPEN:
+        apply_sharpening(src, dst, BORDER_HALO);
+        break;
+    case STAGE_SOBEL:
+        // Gray mode keeps alpha, where the per-channel Sobel differentiates it too
+        apply_sobel(src, dst, static_cast<SobelNorm>(stage.size), gray && src.channels == 3, ImageView(), BORDER_HALO);
+        break;
+    case STAGE_CONVOLUTION:
+        apply_convolution_3x3(src, dst, stage.kernel.data(), BORDER_HALO);
+        break;
+    case STAGE_MEAN:
+        apply_mean_filter(src, dst, stage.size, BORDER_HALO);
+        break;
+    case STAGE_MEDIAN:
+        apply_median_filter(src, dst, stage.size, BORDER_HALO);
+        break;
+    default:
+        break;
+    }
+}
+
+// Rows per strip: about 256 KB of pixels and at least four times the halo.
+// The remainder goes to the last strip, so only the first and the last
+// strip reach past the image.
+static int strip_rows_for(const ImageView &img, int halo)
+{
+    return max(max(16, 4 * halo), min(256, 262144 / max(img.row_bytes(), 1)));
+}
+
+static int strip_end(int strip, int strips, int strip_rows, int height)
+{
+    return strip == strips - 1 ? height : (strip + 1) * strip_rows;
+}
+
+// Run the stages of `pass` on rows [y0, y1) of an image of `height` rows,
+// reading row y (already clamped to the image) through source_row(y) and
+// writing the strip to the same rows of `dst`.
+//
+// The strip plus `halo` rows above and below is loaded into `in`, every
+// stage runs on it (a stencil of radius r shrinks the valid rows by r on
+// each side and ping-pongs into `out`) and the strip is written back, so no
+// full-size intermediate is ever made. Rows above and below the image are
+// re-replicated from the edge row after every stage, which gives exactly the
+// BORDER_REPLICATE result of running the stages one by one. `in` and `out`
+// must hold y1 - y0 + 2 * halo rows with a pad of at least the largest radius.
+template <typename SourceRow>
+static void run_strip(const vector<Stage> &stages, const Pass &pass, const vector<vector<unsigned char>> &luts,
+                      SourceRow source_row, int y0, int y1, int height, PaddedImage *in, PaddedImage *out,
+                      const ImageView &dst, long long *histogram)
+{
+    const int width = dst.width;
+    const int row_bytes = dst.row_bytes();
+    const int halo = pass.halo;
+    const int rows = y1 - y0 + 2 * halo;
+
+    // Without stencils the rows are transformed where they land
+    ImageView result = dst.roi(0, y0, width, y1 - y0);
+    if (halo == 0)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            if (source_row(y) != dst.row(y))
+                memcpy(dst.row(y), source_row(y), row_bytes);
+        }
+    }
+    else
+    {
+        // Tile row i holds image row y0 - halo + i
+        for (int i = 0; i < rows; i++)
+        {
+            memcpy(in->view().row(i), source_row(min(max(y0 - halo + i, 0), height - 1)), row_bytes);
+        }
+    }
+
+    int lo = 0, hi = rows;
+    for (size_t k = pass.first; k < pass.last; k++)
+    {
+        const Stage &stage = stages[k];
+        const ImageView valid = halo == 0 ? result : in->view().roi(0, lo, width, hi - lo);
+        const int r = stencil_radius(stage);
+        if (stage.kind == STAGE_GRAY)
+        {
+            apply_grayscale(valid);
+        }
+        else if (stage.kind == STAGE_POINT)
+        {
+            apply_lut(valid, valid, luts[k].data());
+        }
+        else
+        {
+            in->fill_border(BORDER_REPLICATE);
+            lo += r;
+            hi -= r;
+            run_stencil_stage(stage, in->view().roi(0, lo, width, hi - lo), out->view().roi(0, lo, width, hi - lo),
+                              gray_before(stages, k));
+            swap(in, out);
+
+            const ImageView tile = in->view();
+            for (int i = lo; i < hi; i++)
+            {
+                const int y = y0 - halo + i;
+                if (y < 0)
+                    memcpy(tile.row(i), tile.row(halo - y0), row_bytes);
+            }
+            for (int i = hi - 1; i >= lo; i--)
+            {
+                const int y = y0 - halo + i;
+                if (y >= height)
+                    memcpy(tile.row(i), tile.row(height - 1 - y0 + halo), row_bytes);
+            }
+        }
+    }
+
+    if (halo > 0)
+        copy_image(in->view().roi(0, halo, width, y1 - y0), result);
+    if (histogram != nullptr)
+    {
+        long long strip_histogram[256];
+        compute_histogram(result, strip_histogram);
+        for (int i = 0; i < 256; i++)
+            histogram[i] += strip_histogram[i];
+    }
+}
+
+// Largest stencil radius in a pass, at least 1 so the buffers always have a halo
+static int pass_pad(const vector<Stage> &stages, const Pass &pass)
+{
+    int pad = 1;
+    for (size_t i = pass.first; i < pass.last; i++)
+        pad = max(pad, stencil_radius(stages[i]));
+    return pad;
+}
+
+// Rows [y0, y1) of the packed tensor of `img`
+static void *tensor_rows(const ImageView &img, const TensorFormat &format, unsigned char *tensor, int y0)
+{
+    return tensor + static_cast<size_t>(y0) * img.row_bytes() * tensor_element_bytes(format.type);
+}
+
+// Run a tiled pass in place on `img`. Strips are written back in place, so
+// the first and last `halo` rows of every strip are saved beforehand for
+// the neighbours that read them. With a `format`, every finished strip is
+// also converted into `tensor`.
+static void run_tiled(const vector<Stage> &stages, const Pass &pass, const vector<vector<unsigned char>> &luts,
+                      const ImageView &img, long long histogram[256], const TensorFormat *format = nullptr,
+                      unsigned char *tensor = nullptr)
+{
+    const int height = img.height;
+    const int row_bytes = img.row_bytes();
+    const int halo = pass.halo;
+    const int pad = pass_pad(stages, pass);
+    const int strip_rows = strip_rows_for(img, halo);
+    const int strips = max(1, height / strip_rows);
+
+    vector<unsigned char> edges(static_cast<size_t>(strips) * 2 * halo * row_bytes);
+    auto edge_row = [&](int strip, int i) {
+        return edges.data() + (static_cast<size_t>(strip) * 2 * halo + i) * row_bytes;
+    };
+#pragma omp parallel for
+    for (int s = 0; s < strips; s++)
+    {
+        const int y0 = s * strip_rows, y1 = strip_end(s, strips, strip_rows, height);
+        for (int i = 0; i < halo; i++)
+        {
+            memcpy(edge_row(s, i), img.row(min(y0 + i, y1 - 1)), row_bytes);
+            memcpy(edge_row(s, halo + i), img.row(max(y1 - halo + i, y0)), row_bytes);
+        }
+    }
+
+    if (pass.histogram)
+        fill(histogram, histogram + 256, 0LL);
+
+#pragma omp parallel
+    {
+        PaddedImage a(img.width, 2 * strip_rows + 2 * halo, img.channels, pad);
+        PaddedImage b(img.width, 2 * strip_rows + 2 * halo, img.channels, pad);
+        long long local[256] = {0};
+
+#pragma omp for schedule(dynamic)
+        for (int s = 0; s < strips; s++)
+        {
+            const int y0 = s * strip_rows, y1 = strip_end(s, strips, strip_rows, height);
+            auto source_row = [&](int y) -> const unsigned char * {
+                const int t = min(y / strip_rows, strips - 1);
+                if (t == s)
+                    return img.row(y);
+                if (y < t * strip_rows + halo)
+                    return edge_row(t, y - t * strip_rows);
+                return edge_row(t, halo + y - (strip_end(t, strips, strip_rows, height) - halo));
+            };
+            run_strip(stages, pass, luts, source_row, y0, y1, height, &a, &b, img, pass.histogram ? local : nullptr);
+            if (format != nullptr)
+                convert_to_tensor(img.roi(0, y0, img.width, y1 - y0), tensor_rows(img, *format, tensor, y0), *format);
+        }
+
+        if (pass.histogram)
+        {
+#pragma omp critical(pipeline_histogram)
+            for (int i = 0; i < 256; i++)
+                histogram[i] += local[i];
+        }
+    }
+}
+
+// Fold the point ops of a pass into tables; an equalize at its head reads `histogram`
+static vector<vector<unsigned char>> compile_luts(const vector<Stage> &stages, const Pass &pass, const long long histogram[256])
+{
+    vector<vector<unsigned char>> luts(stages.size());
+    for (size_t k = pass.first; k < pass.last; k++)
+    {
+        if (stages[k].kind != STAGE_POINT)
+            continue;
+        luts[k].resize(256);
+        stages[k].point.compile(histogram, luts[k].data());
+    }
+    return luts;
+}
+
+// The passes of Pipeline::run; `format` (with `tensor`) asks for the result
+// as a tensor, produced inside the last pass when it allows
+static ImageView run_passes(const vector<Stage> &stages, const ImageView &img, const TensorFormat *format,
+                            vector<unsigned char> *tensor)
+{
+    ImageView view = img;
+    long long histogram[256] = {0};
+    bool have_histogram = false;
+    bool converted = false;
+    const vector<Pass> passes = plan_passes(stages);
+    for (const Pass &pass : passes)
+    {
+        // An equalize at the head of a pass reads the histogram the previous
+        // pass gathered, or that of the current image
+        if (needs_histogram(stages[pass.first]) && !have_histogram)
+            compute_histogram(view, histogram);
+        const vector<vector<unsigned char>> luts = compile_luts(stages, pass, histogram);
+        have_histogram = pass.histogram;
+
+        // Only crop-lesion changes the size, and it is never fused
+        const bool last = format != nullptr && &pass == &passes.back() && stages[pass.first].kind != STAGE_CROP_LESION;
+        if (last)
+            tensor->resize(static_cast<size_t>(view.row_bytes()) * view.height * tensor_element_bytes(format->type));
+
+        if (pass.tiled)
+        {
+            run_tiled(stages, pass, luts, view, histogram, last ? format : nullptr, last ? tensor->data() : nullptr);
+            converted = last;
+            continue;
+        }
+
+        const Stage &stage = stages[pass.first];
+        switch (stage.kind)
+        {
+        case STAGE_GRAY:
+            apply_grayscale(view);
+            break;
+        case STAGE_CROP_LESION:
+        {
+            Rect roi = detect_lesion_roi(view, stage.param);
+            view = view.roi(roi.x, roi.y, roi.width, roi.height);
+            break;
+        }
+        case STAGE_CLAHE:
+            apply_clahe(view, stage.size, stage.param);
+            break;
+        case STAGE_CANNY:
+            apply_canny(view, stage.size, static_cast<int>(stage.param));
+            break;
+        case STAGE_POINT:
+            if (!last)
+            {
+                apply_lut(view, view, luts[pass.first].data());
+                break;
+            }
+            // Table and conversion together, 16 rows at a time
+#pragma omp parallel for
+            for (int y0 = 0; y0 < view.height; y0 += 16)
+            {
+                const ImageView rows = view.roi(0, y0, view.width, min(16, view.height - y0));
+                apply_lut(rows, rows, luts[pass.first].data());
+                convert_to_tensor(rows, tensor_rows(view, *format, tensor->data(), y0), *format);
+            }
+            converted = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (format != nullptr && !converted)
+    {
+        tensor->resize(static_cast<size_t>(view.row_bytes()) * view.height * tensor_element_bytes(format->type));
+        convert_to_tensor(view, tensor->data(), *format);
+    }
+    return view;
+}
+
+ImageView Pipeline::run(const ImageView &img) const
+{
+    return run_passes(stages, img, nullptr, nullptr);
+}
+
+ImageView Pipeline::run(const ImageView &img, const TensorFormat &format, vector<unsigned char> &tensor) const
+{
+    return run_passes(stages, img, &format, &tensor);
+}
+
+vector<ImageView> run_fanout(const ImageView &src, const vector<Branch> &branches)
+{
+    // Branches that are a single pass (an equalize may lead, reading the
+    // source histogram) share the strip traversal; the rest run on a copy
+    vector<Pass> passes(branches.size());
+    vector<bool> shared(branches.size());
+    bool source_histogram = false;
+    int halo = 0;
+    for (size_t b = 0; b < branches.size(); b++)
+    {
+        const vector<Stage> &stages = branches[b].pipeline.stages;
+        vector<Pass> plan = plan_passes(stages, true);
+        shared[b] = plan.size() == 1 && (plan[0].tiled || stages[0].kind == STAGE_GRAY || stages[0].kind == STAGE_POINT);
+        if (!shared[b])
+            continue;
+        passes[b] = plan[0];
+        source_histogram = source_histogram || needs_histogram(stages[0]);
+        halo = max(halo, passes[b].halo);
+    }
+
+    long long histogram[256] = {0};
+    if (source_histogram)
+        compute_histogram(src, histogram);
+    vector<vector<vector<unsigned char>>> luts(branches.size());
+    int pad = 1;
+    for (size_t b = 0; b < branches.size(); b++)
+    {
+        if (!shared[b])
+            continue;
+        luts[b] = compile_luts(branches[b].pipeline.stages, passes[b], histogram);
+        pad = max(pad, pass_pad(branches[b].pipeline.stages, passes[b]));
+    }
+
+    // Every branch reads a strip while the previous branch left it in cache
+    const int height = src.height;
+    const int strip_rows = strip_rows_for(src, halo);
+    const int strips = max(1, height / strip_rows);
+#pragma omp parallel
+    {
+        PaddedImage a(src.width, 2 * strip_rows + 2 * halo, src.channels, pad);
+        PaddedImage c(src.width, 2 * strip_rows + 2 * halo, src.channels, pad);
+        auto source_row = [&](int y) -> const unsigned char * { return src.row(y); };
+
+#pragma omp for schedule(dynamic)
+        for (int s = 0; s < strips; s++)
+        {
+            const int y0 = s * strip_rows, y1 = strip_end(s, strips, strip_rows, height);
+            for (size_t b = 0; b < branches.size(); b++)
+            {
+                if (shared[b])
+                    run_strip(branches[b].pipeline.stages, passes[b], luts[b], source_row, y0, y1, height, &a, &c,
+                              branches[b].output, nullptr);
+            }
+        }
+    }
+
+    vector<ImageView> results(branches.size());
+    for (size_t b = 0; b < branches.size(); b++)
+    {
+        results[b] = branches[b].output;
+        if (shared[b])
+            continue;
+        copy_image(src, branches[b].output);
+        results[b] = branches[b].pipeline.run(branches[b].output);
+    }
+    return results;
+}
+
+static string describe_point(const PointOps &point)
+{
+    stringstream ss;
+    for (size_t i = 0; i < point.ops.size(); i++)
+    {
+        const PointOps::Op &op = point.ops[i];
+        ss << (i ? " -> " : "");
+        switch (op.kind)
+        {
+        case PointOps::BRIGHTNESS:
+            ss << "brightness " << op.value;
+            break;
+        case PointOps::CONTRAST:
+            ss << "contrast " << op.factor << " pivot " << op.value;
+            break;
+        case PointOps::EQUALIZE:
+            ss << "equalize";
+            break;
+        case PointOps::TABLE:
+            ss << "table";
+            break;
+        }
+    }
+    ss << " (LUT)";
+    return ss.str();
+}
+
+static string describe_stage(const Stage &stage)
+{
+    stringstream ss;
+    switch (stage.kind)
+    {
+    case STAGE_GRAY:
+        ss << "gray";
+        break;
+    case STAGE_CROP_LESION:
+        ss << "crop-lesion, margin " << stage.param;
+        break;
+    case STAGE_BLUR:
+        if (stage.size == 3 && stage.param == 0.0f)
+            ss << "blur 3x3 binomial";
+        else
+            ss << "blur " << stage.size << "x" << stage.size << " separable, sigma "
+               << (stage.param > 0.0f ? stage.param : stage.size / 2 / 2.0f);
+        break;
+    case STAGE_SHARPEN:
+        ss << "sharpen 3x3";
+        break;
+    case STAGE_UNSHARP:
+        ss << "unsharp amount " << stage.amount << ", threshold " << stage.threshold << ", blur " << stage.size << "x"
+           << stage.size;
+        if (stage.size != 3 || stage.param != 0.0f)
+            ss << " sigma " << (stage.param > 0.0f ? stage.param : stage.size / 2 / 2.0f);
+        break;
+    case STAGE_SOBEL:
+        ss << "sobel 3x3 " << (stage.size == SOBEL_L1 ? "|gx| + |gy|" : "L2");
+        break;
+    case STAGE_CANNY:
+        ss << "canny, thresholds " << stage.size << " / " << stage.param;
+        break;
+    case STAGE_CONVOLUTION:
+        ss << "convolution 3x3";
+        break;
+    case STAGE_MEAN:
+        ss << "mean " << stage.size << "x" << stage.size;
+        break;
+    case STAGE_MEDIAN:
+        ss << "median " << stage.size << "x" << stage.size;
+        break;
+    case STAGE_CLAHE:
+        ss << "clahe " << stage.size << "x" << stage.size << " tiles, clip " << stage.param;
+        break;
+    case STAGE_POINT:
+        ss << describe_point(stage.point);
+        break;
+    }
+    return ss.str();
+}
+
+string Pipeline::describe() const
+{
+    stringstream ss;
+    const vector<Pass> passes = plan_passes(stages);
+    for (size_t p = 0; p < passes.size(); p++)
+    {
+        const Pass &pass = passes[p];
+        ss << "  pass " << p + 1;
+        if (pass.tiled)
+            ss << " (row strips, halo " << pass.halo << ")";
+        ss << ": ";
+        for (size_t k = pass.first; k < pass.last; k++)
+        {
+            ss << (k > pass.first ? " -> " : "") << describe_stage(stages[k]);
+        }
+        if (pass.histogram)
+            ss << " -> histogram";
+        ss << "\n";
+    }
+    return ss.str();
+}
@@ -0,0 +1,115 @@
+#ifndef IMGPROC_PIPELINE_H
+#define IMGPROC_PIPELINE_H
+
+#include "image_view.h"
+#include "point_ops.h"
+#include "tensor.h"
+
+#include <string>
+#include <vector>
+
+// Preprocessing pipeline described as text, e.g.
+//
+//     gray, crop-lesion, blur:3, sharpen, clahe:8
+//
+// Operators are separated by commas or newlines, '#' starts a comment, and
+// arguments follow the name after ':'.
+//
+//     gray                      grayscale (R, G and B)
+//     crop-lesion[:margin]      keep only the detected lesion (see detect_lesion_roi)
+//     blur[:size[:sigma]]       Gaussian; size 3 without sigma is the 3x3 binomial
+//     sharpen                   3x3 {-1 ... 9 ... -1}
+//     unsharp[:amount[:threshold[:size[:sigma]]]]
+//                               unsharp mask, in + amount * (in - blur) (default 1, 0, 3)
+//     sobel[:l1]                Sobel edge magnitude, L2 or |gx| + |gy|
+//     canny[:low[:high]]        Canny edges (255 / 0), hysteresis thresholds
+//     conv:k0:k1:...:k8         3x3 convolution, row-major kernel
+//     mean:size, median:size    box / median filter
+//     clahe[:tiles[:clip]]      contrast-limited adaptive equalization
+//     equalize                  histogram equalization
+//     brightness:offset         out = in + offset
+//     contrast:factor[:pivot]   out = factor * (in - pivot) + pivot
+//
+// parse_pipeline() optimises the chain: consecutive point ops (equalize,
+// brightness, contrast) become one PointOps LUT pass, and monotonic
+// histogram-free point ops are moved across median filters (which commute
+// with them) when that lets them fuse with the next point group. Grayscale
+// conversions after the first are dropped, since every stage keeps R = G = B.
+
+enum StageKind
+{
+    STAGE_GRAY,
+    STAGE_CROP_LESION,
+    STAGE_BLUR,
+    STAGE_SHARPEN,
+    STAGE_UNSHARP,
+    STAGE_SOBEL,
+    STAGE_CANNY,
+    STAGE_CONVOLUTION,
+    STAGE_MEAN,
+    STAGE_MEDIAN,
+    STAGE_CLAHE,
+    STAGE_POINT
+};
+
+struct Stage
+{
+    StageKind kind;
+    int size;                  // kernel size (blur, unsharp, mean, median), tile count (clahe), SobelNorm, canny low
+    float param;               // blur sigma (0 = radius / 2), clahe clip limit, crop margin, canny high
+    PointOps point;            // STAGE_POINT only
+    std::vector<float> kernel; // STAGE_CONVOLUTION only, row-major 3x3
+    float amount = 1.0f;       // STAGE_UNSHARP only
+    int threshold = 0;         // STAGE_UNSHARP only
+};
+
+struct Pipeline
+{
+    std::vector<Stage> stages;
+
+    // Run every stage on `img` in place. Returns the part of `img` holding
+    // the result, which is a roi() of it after crop-lesion.
+    //
+    // Runs of stencils, grayscale and histogram-free point ops execute as one
+    // pass over strips of rows held in per-thread buffers, instead of one
+    // full-image pass (and padded copy) per stage. A pass followed by an
+    // equalize also gathers its output histogram, so the equalize is only a
+    // LUT at the head of the next pass. The result is identical to running
+    // the stages one by one with BORDER_REPLICATE.
+    ImageView run(const ImageView &img) const;
+
+    // As run(), and also convert the result into `tensor` (resized to hold
+    // it, rows packed). When the last pass is tiled or a LUT, each strip is
+    // converted as soon as it is final, while it is still in cache; otherwise
+    // the conversion is one more pass.
+    ImageView run(const ImageView &img, const TensorFormat &format, std::vector<unsigned char> &tensor) const;
+
+    // One line per pass, showing the fused stages and the kernels chosen
+    std::string describe() const;
+};
+
+// One consumer of a fan-out: its stages and a buffer the size of the source
+struct Branch
+{
+    Pipeline pipeline;
+    ImageView output;
+};
+
+// Run several pipelines on the same source without touching it, writing
+// each branch to its own output. Branches that fit in a single pass (after
+// an optional leading equalize, which shares one source histogram) run
+// together strip by strip, so the source is read from memory once and every
+// branch finds the strip in cache. Other branches copy the source and run
+// on their own. Returns each branch's result (a roi() after crop-lesion).
+std::vector<ImageView> run_fanout(const ImageView &src, const std::vector<Branch> &branches);
+
+// The chain process_image has always applied
+const char *const DEFAULT_PIPELINE = "gray,blur,sharpen,equalize";
+
+bool parse_pipeline(const std::string &spec, Pipeline &pipeline, std::string &error);
+bool load_pipeline(const std::string &path, Pipeline &pipeline, std::string &error);
+
+// Fuse and reorder stages; parse_pipeline() already calls this
+void optimise_pipeline(Pipeline &pipeline);
+
+#endif
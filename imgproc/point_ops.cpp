@@ -0,0 +1,276 @@
+#include "point_ops.h"
+#include "kernels.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static inline unsigned char clamp_u8(int v)
+{
+    return static_cast<unsigned char>(min(max(v, 0), 255));
+}
+
+// Number of channels that carry colour, i.e. excluding a trailing alpha channel
+static inline int colour_channels(int channels)
+{
+    return (channels == 2 || channels == 4) ? channels - 1 : channels;
+}
+
+PointOps &PointOps::brightness(int offset)
+{
+    ops.push_back({BRIGHTNESS, 0.0f, offset, {}});
+    return *this;
+}
+
+PointOps &PointOps::contrast(float factor, int pivot)
+{
+    ops.push_back({CONTRAST, factor, pivot, {}});
+    return *this;
+}
+
+PointOps &PointOps::equalize()
+{
+    ops.push_back({EQUALIZE, 0.0f, 0, {}});
+    return *this;
+}
+
+PointOps &PointOps::table(const unsigned char lut[256])
+{
+    ops.push_back({TABLE, 0.0f, 0, vector<unsigned char>(lut, lut + 256)});
+    return *this;
+}
+
+bool PointOps::needs_histogram() const
+{
+    for (const Op &op : ops)
+    {
+        if (op.kind == EQUALIZE)
+            return true;
+    }
+    return false;
+}
+
+// Equalization map of a histogram: round(255 * (cdf - cdf_min) / (total - cdf_min))
+static void equalization_lut(const long long histogram[256], unsigned char lut[256])
+{
+    long long total = 0;
+    long long cdf_min = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        if (cdf_min == 0)
+            cdf_min = histogram[i];
+        total += histogram[i];
+    }
+
+    long long cumulative = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        cumulative += histogram[i];
+        if (total == cdf_min)
+            lut[i] = static_cast<unsigned char>(i); // Single-valued image: nothing to spread
+        else
+            lut[i] = clamp_u8(static_cast<int>(round(255.0 * (cumulative - cdf_min) / (total - cdf_min))));
+    }
+}
+
+void PointOps::compile(const long long histogram[256], unsigned char lut[256]) const
+{
+    for (int i = 0; i < 256; i++)
+    {
+        lut[i] = static_cast<unsigned char>(i);
+    }
+
+    unsigned char step[256];
+    for (const Op &op : ops)
+    {
+        switch (op.kind)
+        {
+        case BRIGHTNESS:
+            for (int i = 0; i < 256; i++)
+                step[i] = clamp_u8(i + op.value);
+            break;
+        case CONTRAST:
+            for (int i = 0; i < 256; i++)
+                step[i] = clamp_u8(static_cast<int>(op.factor * (i - op.value) + op.value));
+            break;
+        case TABLE:
+            memcpy(step, op.table.data(), 256);
+            break;
+        case EQUALIZE:
+        {
+            // Histogram of the values this op actually sees
+            long long seen[256] = {0};
+            for (int i = 0; i < 256; i++)
+            {
+                seen[lut[i]] += histogram[i];
+            }
+            equalization_lut(seen, step);
+            break;
+        }
+        }
+
+        for (int i = 0; i < 256; i++)
+        {
+            lut[i] = step[lut[i]];
+        }
+    }
+}
+
+void PointOps::apply(const ImageView &src, const ImageView &dst) const
+{
+    long long histogram[256] = {0};
+    if (needs_histogram())
+        compute_histogram(src, histogram);
+
+    unsigned char lut[256];
+    compile(histogram, lut);
+    apply_lut(src, dst, lut);
+}
+
+void PointOps::apply(const ImageView &img) const
+{
+    apply(img, img);
+}
+
+void compute_histogram(const ImageView &img, long long histogram[256])
+{
+    const int c = img.channels;
+    const int cc = colour_channels(c);
+    fill(histogram, histogram + 256, 0LL);
+
+#pragma omp parallel
+    {
+        // Four interleaved sub-histograms so consecutive equal bytes do not
+        // serialise on the same counter
+        unsigned partial[4][256] = {{0}};
+#pragma omp for nowait
+        for (int y = 0; y < img.height; y++)
+        {
+            const unsigned char *p = img.row(y);
+            if (cc == c)
+            {
+                const int n = img.row_bytes();
+                int i = 0;
+                for (; i + 4 <= n; i += 4)
+                {
+                    partial[0][p[i]]++;
+                    partial[1][p[i + 1]]++;
+                    partial[2][p[i + 2]]++;
+                    partial[3][p[i + 3]]++;
+                }
+                for (; i < n; i++)
+                    partial[0][p[i]]++;
+                continue;
+            }
+            for (int x = 0; x < img.width; x++, p += c)
+            {
+                for (int ch = 0; ch < cc; ch++)
+                    partial[ch][p[ch]]++;
+            }
+        }
+#pragma omp critical(compute_histogram)
+        for (int i = 0; i < 256; i++)
+        {
+            histogram[i] += static_cast<long long>(partial[0][i]) + partial[1][i] + partial[2][i] + partial[3][i];
+        }
+    }
+}
+
+#if defined(__AVX2__)
+// 256-entry lookup on 32 bytes at a time: the table is split into 16 pshufb
+// tables indexed by the low nibble, and the high nibble selects which one
+// applies. Narrower SSSE3 versions of this lose to the scalar loop.
+static int lut_bytes_avx2(const unsigned char *in, unsigned char *out, int n, const __m256i tables[16])
+{
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        __m256i low = _mm256_and_si256(x, low_mask);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+        __m256i result = _mm256_setzero_si256();
+        for (int j = 0; j < 16; j++)
+        {
+            __m256i hit = _mm256_cmpeq_epi8(high, _mm256_set1_epi8(static_cast<char>(j)));
+            result = _mm256_or_si256(result, _mm256_and_si256(hit, _mm256_shuffle_epi8(tables[j], low)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), result);
+    }
+    return i;
+}
+#endif
+
+void apply_lut(const ImageView &src, const ImageView &dst, const unsigned char lut[256])
+{
+    const int c = src.channels;
+    const int cc = colour_channels(c);
+    const int row_bytes = src.row_bytes();
+
+#if defined(__AVX2__)
+    // vpshufb works within 128-bit lanes, so each sub-table is broadcast to both
+    __m256i tables[16];
+    for (int j = 0; j < 16; j++)
+    {
+        tables[j] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(lut + 16 * j)));
+    }
+#endif
+
+#pragma omp parallel for
+    for (int y = 0; y < src.height; y++)
+    {
+        const unsigned char *in = src.row(y);
+        unsigned char *out = dst.row(y);
+        if (cc != c)
+        {
+            for (int x = 0; x < src.width; x++, in += c, out += c)
+            {
+                for (int ch = 0; ch < cc; ch++)
+                    out[ch] = lut[in[ch]];
+                out[cc] = in[cc];
+            }
+            continue;
+        }
+
+        int i = 0;
+#if defined(__AVX2__)
+        i = lut_bytes_avx2(in, out, row_bytes, tables);
+#endif
+        for (; i < row_bytes; i++)
+        {
+            out[i] = lut[in[i]];
+        }
+    }
+}
+
+void apply_histogram_equalization(const ImageView &img)
+{
+    PointOps().equalize().apply(img);
+}
+
+void apply_contrast_adjustment(const ImageView &src, const ImageView &dst, float factor, int pivot)
+{
+    PointOps().contrast(factor, pivot).apply(src, dst);
+}
+
+void apply_contrast_adjustment(const ImageView &img, float factor, int pivot)
+{
+    apply_contrast_adjustment(img, img, factor, pivot);
+}
+
+void apply_brightness_correction(const ImageView &src, const ImageView &dst, int offset)
+{
+    PointOps().brightness(offset).apply(src, dst);
+}
+
+void apply_brightness_correction(const ImageView &img, int offset)
+{
+    apply_brightness_correction(img, img, offset);
+}
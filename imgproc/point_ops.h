@@ -0,0 +1,63 @@
+#ifndef IMGPROC_POINT_OPS_H
+#define IMGPROC_POINT_OPS_H
+
+#include "image_view.h"
+
+#include <vector>
+
+// Chain of per-pixel uint8 -> uint8 maps (brightness, contrast, histogram
+// equalization, arbitrary tables) folded into a single 256-entry LUT.
+//
+// Equalization needs the histogram of the values it sees, which in a chain
+// are already transformed. The source histogram is computed once and pushed
+// through the table built so far (hist'[lut[v]] += hist[v]), so the whole
+// chain costs one histogram pass (only if it equalizes) plus one LUT pass.
+//
+// Point ops touch the colour channels only; a trailing alpha channel is copied.
+struct PointOps
+{
+    enum Kind
+    {
+        BRIGHTNESS,
+        CONTRAST,
+        EQUALIZE,
+        TABLE
+    };
+
+    struct Op
+    {
+        Kind kind;
+        float factor;
+        int value;
+        std::vector<unsigned char> table;
+    };
+
+    std::vector<Op> ops;
+
+    // out = in + offset, clamped to [0, 255]
+    PointOps &brightness(int offset);
+    // out = factor * (in - pivot) + pivot, clamped to [0, 255]
+    PointOps &contrast(float factor, int pivot = 128);
+    // Histogram equalization of the values produced by the ops before it
+    PointOps &equalize();
+    // Arbitrary map
+    PointOps &table(const unsigned char lut[256]);
+
+    bool needs_histogram() const;
+
+    // Fold the chain into `lut`. `histogram` is the colour-channel histogram
+    // of the source and is only read when needs_histogram() is true.
+    void compile(const long long histogram[256], unsigned char lut[256]) const;
+
+    // Fold and apply in a single pass over the pixels
+    void apply(const ImageView &src, const ImageView &dst) const;
+    void apply(const ImageView &img) const;
+};
+
+// Colour-channel histogram of an image (alpha excluded)
+void compute_histogram(const ImageView &img, long long histogram[256]);
+
+// Apply a 256-entry table to the colour channels of src, writing dst
+void apply_lut(const ImageView &src, const ImageView &dst, const unsigned char lut[256]);
+
+#endif
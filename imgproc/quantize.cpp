@@ -0,0 +1,430 @@
+#include "quantize.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Output columns per packed weight panel, and the bytes of one group of four
+// K values of a panel (16 columns x 4)
+static const int PANEL = 16;
+static const int GROUP_BYTES = PANEL * 4;
+static const float QMAX = 127.0f;
+
+// Inputs of one output value
+static int kernel_depth(const Layer &layer)
+{
+    return layer.type == LAYER_CONV2D ? layer.kernel_height * layer.kernel_width * layer.inputs : layer.inputs;
+}
+
+// Rounded up to whole groups of four
+static int padded_depth(int depth)
+{
+    return (depth + 3) & ~3;
+}
+
+// Float result to the output type: kept as is, or rounded to 0..127 steps
+template <typename T>
+static inline void store_output(T *c, float v, float inverse_step)
+{
+    if constexpr (is_same_v<T, float>)
+        *c = v;
+    else
+        *c = static_cast<uint8_t>(max(nearbyintf(min(v * inverse_step, QMAX)), 0.0f));
+}
+
+// Column j of a packed panel times one u8 row
+static inline int32_t dot_column(const uint8_t *a, const int8_t *B, int groups, int j)
+{
+    int32_t sum = 0;
+    for (int g = 0; g < groups; g++)
+    {
+        for (int t = 0; t < 4; t++)
+            sum += a[4 * g + t] * B[g * GROUP_BYTES + j * 4 + t];
+    }
+    return sum;
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+// acc + four u8 x s8 products per int32 lane
+static inline __m256i dot4(__m256i acc, __m256i a, __m256i b)
+{
+#if defined(__AVXVNNI__)
+    return _mm256_dpbusd_avx_epi32(acc, a, b);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    return _mm256_dpbusd_epi32(acc, a, b);
+#else
+    // Pair sums are at most 2 x 127 x 127, inside int16
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), _mm256_set1_epi16(1)));
+#endif
+}
+
+template <typename T>
+static inline void store_vector(T *c, __m256 v0, __m256 v1, float inverse_step)
+{
+    if constexpr (is_same_v<T, float>)
+    {
+        _mm256_storeu_ps(c, v0);
+        _mm256_storeu_ps(c + 8, v1);
+    }
+    else
+    {
+        const __m256 inverse = _mm256_set1_ps(inverse_step), top = _mm256_set1_ps(QMAX);
+        const __m256i q0 = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_mul_ps(v0, inverse), top));
+        const __m256i q1 = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_mul_ps(v1, inverse), top));
+        const __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(q0, q1), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(c),
+                         _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1)));
+    }
+}
+#endif
+
+// Rows [0, ROWS) x 16 columns: int32 dot products of u8 rows of A with a
+// packed panel, then acc * scale + bias, ReLU optional, stored as T
+template <int ROWS, typename T>
+static void qgemm_block(const uint8_t *A, int lda, const int8_t *B, int groups, T *C, int ldc, const float *scale,
+                        const float *bias, bool relu, float inverse_step)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256i acc[ROWS][2];
+    for (int r = 0; r < ROWS; r++)
+        acc[r][0] = acc[r][1] = _mm256_setzero_si256();
+    const int8_t *b = B;
+    for (int g = 0; g < groups; g++, b += GROUP_BYTES)
+    {
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+        const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + 32));
+        for (int r = 0; r < ROWS; r++)
+        {
+            int32_t word;
+            memcpy(&word, A + r * lda + 4 * g, 4);
+            const __m256i a = _mm256_set1_epi32(word);
+            acc[r][0] = dot4(acc[r][0], a, b0);
+            acc[r][1] = dot4(acc[r][1], a, b1);
+        }
+    }
+    const __m256 scale0 = _mm256_loadu_ps(scale), scale1 = _mm256_loadu_ps(scale + 8);
+    const __m256 bias0 = _mm256_loadu_ps(bias), bias1 = _mm256_loadu_ps(bias + 8);
+    const __m256 zero = _mm256_setzero_ps();
+    for (int r = 0; r < ROWS; r++)
+    {
+        __m256 v0 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(acc[r][0]), scale0, bias0);
+        __m256 v1 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(acc[r][1]), scale1, bias1);
+        if (relu)
+        {
+            v0 = _mm256_max_ps(v0, zero);
+            v1 = _mm256_max_ps(v1, zero);
+        }
+        store_vector(C + r * ldc, v0, v1, inverse_step);
+    }
+#else
+    for (int r = 0; r < ROWS; r++)
+    {
+        for (int j = 0; j < PANEL; j++)
+        {
+            float v = fmaf(static_cast<float>(dot_column(A + r * lda, B, groups, j)), scale[j], bias[j]);
+            store_output(C + r * ldc + j, relu ? max(v, 0.0f) : v, inverse_step);
+        }
+    }
+#endif
+}
+
+// C[M][0..columns) for one packed panel, single-threaded
+template <typename T>
+static void qgemm(const uint8_t *A, int lda, const int8_t *B, int groups, T *C, int ldc, int M, int columns,
+                  const float *scale, const float *bias, bool relu, float inverse_step)
+{
+    if (columns < PANEL)
+    {
+        // Partial last panel (the single sigmoid unit)
+        for (int m = 0; m < M; m++)
+        {
+            for (int j = 0; j < columns; j++)
+            {
+                float v = fmaf(static_cast<float>(dot_column(A + static_cast<size_t>(m) * lda, B, groups, j)), scale[j],
+                               bias[j]);
+                store_output(C + static_cast<size_t>(m) * ldc + j, relu ? max(v, 0.0f) : v, inverse_step);
+            }
+        }
+        return;
+    }
+
+    int m = 0;
+    for (; m + 6 <= M; m += 6)
+        qgemm_block<6>(A + static_cast<size_t>(m) * lda, lda, B, groups, C + static_cast<size_t>(m) * ldc, ldc, scale,
+                       bias, relu, inverse_step);
+    const uint8_t *a = A + static_cast<size_t>(m) * lda;
+    T *c = C + static_cast<size_t>(m) * ldc;
+    switch (M - m)
+    {
+    case 5:
+        qgemm_block<5>(a, lda, B, groups, c, ldc, scale, bias, relu, inverse_step);
+        break;
+    case 4:
+        qgemm_block<4>(a, lda, B, groups, c, ldc, scale, bias, relu, inverse_step);
+        break;
+    case 3:
+        qgemm_block<3>(a, lda, B, groups, c, ldc, scale, bias, relu, inverse_step);
+        break;
+    case 2:
+        qgemm_block<2>(a, lda, B, groups, c, ldc, scale, bias, relu, inverse_step);
+        break;
+    case 1:
+        qgemm_block<1>(a, lda, B, groups, c, ldc, scale, bias, relu, inverse_step);
+        break;
+    }
+}
+
+// All panels of a layer for M rows of A (lda >= padded depth, zero padded)
+template <typename T>
+static void qgemm_panels(const Layer &layer, const uint8_t *A, int lda, T *C, int ldc, int M)
+{
+    const int groups = padded_depth(kernel_depth(layer)) / 4;
+    const bool relu = layer.activation == ACTIVATION_RELU;
+    const float inverse_step = layer.output_step > 0.0f ? 1.0f / layer.output_step : 0.0f;
+    for (int n0 = 0; n0 < layer.outputs; n0 += PANEL)
+    {
+        qgemm(A, lda, layer.qweights.data() + static_cast<size_t>(n0 / PANEL) * groups * GROUP_BYTES, groups, C + n0,
+              ldc, M, min(PANEL, layer.outputs - n0), layer.qscales.data() + n0, layer.bias.data() + n0, relu,
+              inverse_step);
+    }
+}
+
+// im2col per output row as in cnn.cpp, on bytes, with each patch padded to a
+// whole number of groups
+template <typename T>
+static void conv2d_int8(const Layer &layer, const uint8_t *in, Shape s, T *out, Shape o, int batch)
+{
+    const int kw = layer.kernel_width, kh = layer.kernel_height;
+    const int depth = padded_depth(kernel_depth(layer));
+    const int span = kw * s.channels;
+#pragma omp parallel
+    {
+        vector<uint8_t> patches(static_cast<size_t>(o.width) * depth, 0); // padding stays zero
+#pragma omp for schedule(dynamic)
+        for (int r = 0; r < batch * o.height; r++)
+        {
+            const int b = r / o.height, y = r % o.height;
+            const uint8_t *image = in + b * s.size();
+            for (int x = 0; x < o.width; x++)
+            {
+                for (int ky = 0; ky < kh; ky++)
+                {
+                    const uint8_t *src = image + (static_cast<size_t>(y + ky) * s.width + x) * s.channels;
+                    memcpy(&patches[static_cast<size_t>(x) * depth + ky * span], src, span);
+                }
+            }
+            T *row = out + b * o.size() + static_cast<size_t>(y) * o.width * o.channels;
+            qgemm_panels(layer, patches.data(), depth, row, o.channels, o.width);
+        }
+    }
+}
+
+// Max pooling commutes with the (monotonic) quantisation, so it runs on bytes
+static void maxpool_int8(const Layer &layer, const uint8_t *in, Shape s, uint8_t *out, Shape o, int batch)
+{
+    const int c = s.channels;
+#pragma omp parallel for
+    for (int r = 0; r < batch * o.height; r++)
+    {
+        const int b = r / o.height, y = r % o.height;
+        const uint8_t *image = in + b * s.size();
+        uint8_t *dst = out + b * o.size() + static_cast<size_t>(y) * o.width * c;
+        for (int x = 0; x < o.width; x++, dst += c)
+        {
+            const uint8_t *first = image + (static_cast<size_t>(y * layer.kernel_height) * s.width + x * layer.kernel_width) * c;
+            memcpy(dst, first, c);
+            for (int py = 0; py < layer.kernel_height; py++)
+            {
+                for (int px = 0; px < layer.kernel_width; px++)
+                {
+                    const uint8_t *p = first + (static_cast<size_t>(py) * s.width + px) * c;
+                    for (int ch = 0; ch < c; ch++)
+                        dst[ch] = max(dst[ch], p[ch]);
+                }
+            }
+        }
+    }
+}
+
+// The threads take 16-column panels, as in the float dense layer
+template <typename T>
+static void dense_int8(const Layer &layer, const uint8_t *in, T *out, int batch, vector<uint8_t> &padded)
+{
+    const int depth = padded_depth(layer.inputs);
+    if (depth != layer.inputs)
+    {
+        padded.assign(static_cast<size_t>(batch) * depth, 0);
+        for (int b = 0; b < batch; b++)
+            memcpy(&padded[static_cast<size_t>(b) * depth], in + static_cast<size_t>(b) * layer.inputs, layer.inputs);
+        in = padded.data();
+    }
+
+    const int groups = depth / 4;
+    const bool relu = layer.activation == ACTIVATION_RELU;
+    const float inverse_step = layer.output_step > 0.0f ? 1.0f / layer.output_step : 0.0f;
+    const int panels = (layer.outputs + PANEL - 1) / PANEL;
+#pragma omp parallel for schedule(dynamic)
+    for (int p = 0; p < panels; p++)
+    {
+        const int n0 = p * PANEL;
+        qgemm(in, depth, layer.qweights.data() + static_cast<size_t>(p) * groups * GROUP_BYTES, groups, out + n0,
+              layer.outputs, batch, min(PANEL, layer.outputs - n0), layer.qscales.data() + n0, layer.bias.data() + n0,
+              relu, inverse_step);
+    }
+}
+
+void forward_int8(const Model &model, const float *input, int batch, float *output, Activations &buffers)
+{
+    vector<uint8_t> &a = buffers.qa, &b = buffers.qb;
+    Shape shape = {model.height, model.width, model.channels};
+
+    const long long count = static_cast<long long>(shape.size()) * batch;
+    const float inverse_step = 1.0f / model.input_step;
+    a.resize(count);
+#pragma omp parallel for
+    for (long long i = 0; i < count; i++)
+        store_output(&a[i], input[i], inverse_step);
+
+    const uint8_t *in = a.data();
+    vector<uint8_t> padded;
+    for (size_t i = 0; i < model.layers.size(); i++)
+    {
+        const Layer &layer = model.layers[i];
+        const Shape next = output_shape(layer, shape);
+        const bool last = i + 1 == model.layers.size(); // conv2d or dense, float output
+        uint8_t *out = nullptr;
+        if (!last)
+        {
+            vector<uint8_t> &buffer = in == a.data() ? b : a;
+            buffer.resize(next.size() * batch);
+            out = buffer.data();
+        }
+
+        switch (layer.type)
+        {
+        case LAYER_CONV2D:
+            if (last)
+                conv2d_int8(layer, in, shape, output, next, batch);
+            else
+                conv2d_int8(layer, in, shape, out, next, batch);
+            break;
+        case LAYER_MAXPOOL:
+            maxpool_int8(layer, in, shape, out, next, batch);
+            break;
+        case LAYER_FLATTEN:
+            memcpy(out, in, shape.size() * batch);
+            break;
+        case LAYER_DENSE:
+            if (last)
+                dense_int8(layer, in, output, batch, padded);
+            else
+                dense_int8(layer, in, out, batch, padded);
+            break;
+        }
+        in = out;
+        shape = next;
+    }
+
+    const Layer &last = model.layers.back();
+    if (last.activation == ACTIVATION_SIGMOID)
+    {
+        for (int i = 0; i < batch * last.outputs; i++)
+            output[i] = 1.0f / (1.0f + exp(-output[i]));
+    }
+}
+
+// int8 weights with one step per output (max |w| / 127), packed in panels
+static void quantize_weights(Layer &layer, float input_step)
+{
+    const int depth = kernel_depth(layer);
+    const int groups = padded_depth(depth) / 4;
+    const int panels = (layer.outputs + PANEL - 1) / PANEL;
+    auto weight = [&](int k, int n)
+    {
+        // conv2d HWIO flattens to [depth][outputs]; dense is in float panels
+        if (layer.type == LAYER_CONV2D)
+            return layer.weights[static_cast<size_t>(k) * layer.outputs + n];
+        return layer.weights[(static_cast<size_t>(n / PANEL) * depth + k) * PANEL + n % PANEL];
+    };
+
+    layer.qweights.assign(static_cast<size_t>(panels) * groups * GROUP_BYTES, 0);
+    layer.qscales.resize(layer.outputs);
+    for (int n = 0; n < layer.outputs; n++)
+    {
+        float largest = 0.0f;
+        for (int k = 0; k < depth; k++)
+            largest = max(largest, fabsf(weight(k, n)));
+        const float step = largest > 0.0f ? largest / QMAX : 1.0f;
+        layer.qscales[n] = input_step * step;
+
+        int8_t *panel = layer.qweights.data() + static_cast<size_t>(n / PANEL) * groups * GROUP_BYTES;
+        for (int k = 0; k < depth; k++)
+        {
+            const float q = min(max(nearbyintf(weight(k, n) / step), -QMAX), QMAX);
+            panel[(k / 4) * GROUP_BYTES + (n % PANEL) * 4 + k % 4] = static_cast<int8_t>(q);
+        }
+    }
+}
+
+bool quantize_model(Model &model, const float *inputs, int count, string &error)
+{
+    if (model.quantized)
+    {
+        error = "the model is already quantized";
+        return false;
+    }
+    if (count < 1)
+    {
+        error = "no calibration inputs";
+        return false;
+    }
+    const size_t last = model.layers.size() - 1;
+    if (model.layers.empty() || (model.layers[last].type != LAYER_CONV2D && model.layers[last].type != LAYER_DENSE))
+    {
+        error = "the last layer must be Conv2D or Dense";
+        return false;
+    }
+    for (size_t i = 0; i < last; i++)
+    {
+        const Layer &layer = model.layers[i];
+        if ((layer.type == LAYER_CONV2D || layer.type == LAYER_DENSE) && layer.activation != ACTIVATION_RELU)
+        {
+            error = "layer " + to_string(i) + " has no ReLU, so its output cannot be unsigned 8-bit";
+            return false;
+        }
+    }
+
+    // Largest output of every layer on the calibration inputs
+    const size_t input_size = static_cast<size_t>(model.height) * model.width * model.channels;
+    const int batch = 8;
+    vector<float> layer_max(model.layers.size(), 0.0f);
+    vector<float> output(static_cast<size_t>(model.output_size()) * batch);
+    Activations buffers;
+    for (int i = 0; i < count; i += batch)
+        model.forward(inputs + i * input_size, min(batch, count - i), output.data(), buffers, layer_max.data());
+    const float input_max = *max_element(inputs, inputs + count * input_size);
+
+    // Steps of 1e-6 at least, so an all-zero calibration stays finite
+    model.input_step = max(input_max, 1e-6f) / QMAX;
+    float step = model.input_step;
+    for (size_t i = 0; i < model.layers.size(); i++)
+    {
+        Layer &layer = model.layers[i];
+        if (layer.type != LAYER_CONV2D && layer.type != LAYER_DENSE)
+            continue; // pooling and flatten keep the step
+        quantize_weights(layer, step);
+        layer.output_step = i == last ? 0.0f : max(layer_max[i], 1e-6f) / QMAX;
+        step = layer.output_step;
+    }
+    model.quantized = true;
+    return true;
+}
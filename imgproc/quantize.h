@@ -0,0 +1,32 @@
+#ifndef IMGPROC_QUANTIZE_H
+#define IMGPROC_QUANTIZE_H
+
+#include "cnn.h"
+
+#include <string>
+
+// Post-training INT8 quantisation of a float Model (cnn.h).
+//
+//  - Conv2D / Dense weights become int8 with one symmetric scale per output
+//    channel (max |w| -> 127).
+//  - Activations become 7-bit unsigned (0..127) with one step per layer,
+//    calibrated as the largest value the float model produces on sample
+//    inputs. They are non-negative after ReLU, so no zero point is needed,
+//    and 7 bits keep the AVX2 vpmaddubsw pair sums (2 x 127 x 127) from
+//    saturating, so every kernel gives the exact same int32 dot products.
+//  - Each output is acc * input step * weight step + bias (float, fused
+//    with ReLU), rounded to the next layer's step; the last layer stays float.
+//
+// Dot products use AVX-VNNI / AVX512-VNNI vpdpbusd when the compiler
+// targets it, AVX2 vpmaddubsw + vpmaddwd otherwise, and a scalar loop
+// without AVX2; all three agree bit for bit.
+
+// Calibrate on `count` prepared inputs (prepare_input) and quantise `model`
+// in place; forward then runs the INT8 path. Every Conv2D / Dense layer but
+// the last must use ReLU.
+bool quantize_model(Model &model, const float *inputs, int count, std::string &error);
+
+// Model::forward of a quantized model
+void forward_int8(const Model &model, const float *input, int batch, float *output, Activations &buffers);
+
+#endif
@@ -0,0 +1,150 @@
+#include "roi.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+int otsu_threshold(const long long histogram[256], long long total)
+{
+    double sum_all = 0.0;
+    for (int i = 0; i < 256; i++)
+    {
+        sum_all += static_cast<double>(i) * histogram[i];
+    }
+
+    // Maximise the between-class variance w0 * w1 * (mu0 - mu1)^2
+    double sum_below = 0.0;
+    long long weight_below = 0;
+    double best_variance = -1.0;
+    int threshold = 0;
+    for (int t = 0; t < 256; t++)
+    {
+        weight_below += histogram[t];
+        if (weight_below == 0)
+            continue;
+        long long weight_above = total - weight_below;
+        if (weight_above == 0)
+            break;
+
+        sum_below += static_cast<double>(t) * histogram[t];
+        double mean_below = sum_below / weight_below;
+        double mean_above = (sum_all - sum_below) / weight_above;
+        double variance = static_cast<double>(weight_below) * weight_above * (mean_below - mean_above) * (mean_below - mean_above);
+        if (variance > best_variance)
+        {
+            best_variance = variance;
+            threshold = t;
+        }
+    }
+    return threshold;
+}
+
+Rect detect_lesion_roi(const ImageView &gray, float margin)
+{
+    const Rect whole = {0, 0, gray.width, gray.height};
+    const int step = max(1, max(gray.width, gray.height) / 128);
+    const int sw = gray.width / step;
+    const int sh = gray.height / step;
+    if (sw < 3 || sh < 3)
+        return whole;
+
+    // Box-downscale by `step` and build its histogram: channel 0, or the mean
+    // of R, G and B for colour images (the same for gray written to all three)
+    vector<unsigned char> small(static_cast<size_t>(sw) * sh);
+    long long histogram[256] = {0};
+    const int c = gray.channels;
+    const int samples = c >= 3 ? 3 : 1;
+#pragma omp parallel for reduction(+ : histogram[ : 256])
+    for (int sy = 0; sy < sh; sy++)
+    {
+        for (int sx = 0; sx < sw; sx++)
+        {
+            int sum = 0;
+            for (int y = sy * step; y < (sy + 1) * step; y++)
+            {
+                const unsigned char *p = gray.pixel(sx * step, y);
+                for (int x = 0; x < step; x++, p += c)
+                {
+                    sum += samples == 3 ? p[0] + p[1] + p[2] : *p;
+                }
+            }
+            unsigned char v = static_cast<unsigned char>(sum / (samples * step * step));
+            small[sy * sw + sx] = v;
+            histogram[v]++;
+        }
+    }
+    const int threshold = otsu_threshold(histogram, static_cast<long long>(sw) * sh);
+
+    // Label the dark components. Prefer the largest one not touching the frame
+    // (dark vignette corners always do); otherwise take the one under the centre.
+    vector<int> label(small.size(), -1);
+    vector<int> stack;
+    Rect best = whole;
+    int best_area = 0;
+    Rect centre_box = whole;
+    bool centre_found = false;
+    const int centre = (sh / 2) * sw + sw / 2;
+    int next_label = 0;
+    for (int start = 0; start < sw * sh; start++)
+    {
+        if (small[start] > threshold || label[start] >= 0)
+            continue;
+
+        int x0 = sw, y0 = sh, x1 = -1, y1 = -1, area = 0;
+        bool has_centre = false;
+        label[start] = next_label;
+        stack.push_back(start);
+        while (!stack.empty())
+        {
+            int i = stack.back();
+            stack.pop_back();
+            int x = i % sw, y = i / sw;
+            x0 = min(x0, x), x1 = max(x1, x), y0 = min(y0, y), y1 = max(y1, y);
+            area++;
+            has_centre |= (i == centre);
+
+            const int neighbours[4] = {x > 0 ? i - 1 : -1, x < sw - 1 ? i + 1 : -1, y > 0 ? i - sw : -1, y < sh - 1 ? i + sw : -1};
+            for (int n : neighbours)
+            {
+                if (n >= 0 && label[n] < 0 && small[n] <= threshold)
+                {
+                    label[n] = next_label;
+                    stack.push_back(n);
+                }
+            }
+        }
+        next_label++;
+
+        Rect box = {x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+        bool touches_frame = x0 == 0 || y0 == 0 || x1 == sw - 1 || y1 == sh - 1;
+        if (!touches_frame && area > best_area)
+        {
+            best = box;
+            best_area = area;
+        }
+        if (has_centre)
+        {
+            centre_box = box;
+            centre_found = true;
+        }
+    }
+
+    // Ignore specks below 1% of the image
+    if (best_area * 100 < sw * sh)
+    {
+        if (!centre_found)
+            return whole;
+        best = centre_box;
+    }
+
+    // Grow by the margin and map back to full resolution
+    int mx = static_cast<int>(best.width * margin + 0.5f) + 1;
+    int my = static_cast<int>(best.height * margin + 0.5f) + 1;
+    int x0 = max(0, (best.x - mx) * step);
+    int y0 = max(0, (best.y - my) * step);
+    int x1 = min(gray.width, (best.x + best.width + mx) * step);
+    int y1 = min(gray.height, (best.y + best.height + my) * step);
+    return {x0, y0, x1 - x0, y1 - y0};
+}
@@ -0,0 +1,24 @@
+#ifndef IMGPROC_ROI_H
+#define IMGPROC_ROI_H
+
+#include "image_view.h"
+
+struct Rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Otsu threshold of a 256-bin histogram with `total` samples
+int otsu_threshold(const long long histogram[256], long long total);
+
+// Bounding box of the lesion in a grayscale image (channel 0, as written by
+// apply_grayscale) or a colour one (the mean of R, G and B). The image is box-downscaled to ~128 pixels,
+// thresholded with Otsu, and the dark connected component that best looks
+// like a central lesion is boxed and grown by `margin` of its size on each
+// side. Returns the whole image when no plausible lesion is found.
+Rect detect_lesion_roi(const ImageView &gray, float margin = 0.1f);
+
+#endif
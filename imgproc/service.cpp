@@ -0,0 +1,441 @@
+#include "service.h"
+#include "decode.h"
+#include "../stb_image.h"
+#include "../stb_image_write.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#if defined(_WIN32)
+
+bool run_service(const string &socket_path, const ServiceOptions &, string &error)
+{
+    error = "the service needs Unix domain sockets and epoll, not available for " + socket_path;
+    return false;
+}
+
+int connect_service(const string &socket_path, string &error)
+{
+    error = "Unix domain sockets are not available for " + socket_path;
+    return -1;
+}
+
+size_t run_stream(int, int, const ServiceOptions &)
+{
+    return 0;
+}
+
+bool send_request(int, RequestHeader, const string &, const void *, size_t, const string &)
+{
+    return false;
+}
+
+bool read_response(int, ResponseHeader &, vector<unsigned char> &)
+{
+    return false;
+}
+
+#else
+
+// Parsed pipelines kept per worker; the cache is dropped when it grows past this
+static const size_t MAX_CACHED_PIPELINES = 64;
+// A client that stalls mid-request gives its worker back after this long
+static const int RECEIVE_TIMEOUT_SECONDS = 5;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+static bool read_all(int fd, void *data, size_t bytes)
+{
+    unsigned char *p = static_cast<unsigned char *>(data);
+    while (bytes > 0)
+    {
+        const ssize_t n = read(fd, p, bytes);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// send() on sockets, so a closed peer is an error rather than SIGPIPE;
+// write() otherwise (--stream to a pipe or file)
+static bool write_all(int fd, bool socket, const void *data, size_t bytes)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    while (bytes > 0)
+    {
+        const ssize_t n = socket ? send(fd, p, bytes, MSG_NOSIGNAL) : write(fd, p, bytes);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// What a worker keeps between requests: buffers only grow, so steady-state
+// requests do no I/O allocation, and each spec is parsed once
+struct Worker
+{
+    vector<unsigned char> request; // spec, input and output path
+    vector<unsigned char> encoded; // JPEG / PNG response payload
+    map<string, Pipeline> pipelines;
+};
+
+static void append_bytes(void *context, void *data, int size)
+{
+    vector<unsigned char> *out = static_cast<vector<unsigned char> *>(context);
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    out->insert(out->end(), bytes, bytes + size);
+}
+
+// Error response; the connection stays usable since the request was read whole
+static bool send_error(int fd, bool socket, ServiceStatus status, const string &message)
+{
+    ResponseHeader response = {};
+    memcpy(response.magic, RESPONSE_MAGIC, 4);
+    response.status = status;
+    response.payload_bytes = message.size();
+    return write_all(fd, socket, &response, sizeof(response)) && write_all(fd, socket, message.data(), message.size());
+}
+
+static bool write_output(const string &path, OutputFormat format, int width, int height, int channels,
+                         const unsigned char *pixels, int quality)
+{
+    switch (format)
+    {
+    case OUTPUT_PNG:
+        return stbi_write_png(path.c_str(), width, height, channels, pixels, width * channels) != 0;
+    case OUTPUT_RAW:
+    {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+            return false;
+        const size_t bytes = static_cast<size_t>(width) * height * channels;
+        const bool written = fwrite(pixels, 1, bytes, file) == bytes;
+        return fclose(file) == 0 && written;
+    }
+    default:
+        return stbi_write_jpg(path.c_str(), width, height, channels, pixels, quality) != 0;
+    }
+}
+
+// Serve one request from a readable connection (or stdin), answering on
+// out_fd (a socket if out_socket). False once the connection is closed or out
+// of step with the protocol.
+static bool serve_request(int fd, int out_fd, bool out_socket, Worker &worker, const ServiceOptions &options)
+{
+    RequestHeader header;
+    if (!read_all(fd, &header, sizeof(header)))
+        return false; // closed between requests
+    if (memcmp(header.magic, REQUEST_MAGIC, 4) != 0)
+    {
+        send_error(out_fd, out_socket, SERVICE_BAD_REQUEST, "not a request header");
+        return false;
+    }
+    const uint64_t body = static_cast<uint64_t>(header.spec_bytes) + header.input_bytes + header.output_bytes;
+    if (body > static_cast<uint64_t>(options.max_request_mb) << 20)
+    {
+        send_error(out_fd, out_socket, SERVICE_BAD_REQUEST,
+                   "request larger than " + to_string(options.max_request_mb) + " MB");
+        return false;
+    }
+    worker.request.resize(body);
+    if (!read_all(fd, worker.request.data(), body))
+        return false;
+
+    const char *text = reinterpret_cast<const char *>(worker.request.data());
+    const string spec(text, header.spec_bytes);
+    const unsigned char *input = worker.request.data() + header.spec_bytes;
+    const string output(text + header.spec_bytes + header.input_bytes, header.output_bytes);
+    const OutputFormat format = header.format <= OUTPUT_RAW ? static_cast<OutputFormat>(header.format) : OUTPUT_JPEG;
+    const int quality = header.quality == 0 ? 100 : min(max(static_cast<int>(header.quality), 1), 100);
+
+    const Pipeline *pipeline = &options.pipeline;
+    if (!spec.empty())
+    {
+        auto it = worker.pipelines.find(spec);
+        if (it == worker.pipelines.end())
+        {
+            Pipeline parsed;
+            string error;
+            if (!parse_pipeline(spec, parsed, error))
+                return send_error(out_fd, out_socket, SERVICE_BAD_PIPELINE, error);
+            if (worker.pipelines.size() >= MAX_CACHED_PIPELINES)
+                worker.pipelines.clear();
+            it = worker.pipelines.emplace(spec, move(parsed)).first;
+        }
+        pipeline = &it->second;
+    }
+
+    int width, height, channels;
+    unsigned char *img;
+    string source = "image bytes";
+    const bool raw = (header.flags & REQUEST_RAW) != 0;
+    if (raw)
+    {
+        // Processed in place in the request buffer, no decode or copy
+        FrameHeader frame;
+        if (header.input_bytes < sizeof(frame))
+            return send_error(out_fd, out_socket, SERVICE_BAD_REQUEST, "raw frame without a FrameHeader");
+        memcpy(&frame, input, sizeof(frame));
+        if (frame.channels < 1 || frame.channels > 4 || frame.width == 0 || frame.height == 0 ||
+            static_cast<uint64_t>(frame.width) * frame.height * frame.channels != header.input_bytes - sizeof(frame))
+            return send_error(out_fd, out_socket, SERVICE_BAD_REQUEST, "raw frame size does not match its FrameHeader");
+        width = static_cast<int>(frame.width);
+        height = static_cast<int>(frame.height);
+        channels = static_cast<int>(frame.channels);
+        img = worker.request.data() + header.spec_bytes + sizeof(frame);
+    }
+    else
+    {
+        DecodeStatus status;
+        const char *reason;
+        if (header.flags & REQUEST_PATH)
+        {
+            source.assign(reinterpret_cast<const char *>(input), header.input_bytes);
+            img = options.sandbox ? decode_image_sandboxed(source.c_str(), width, height, channels, status, reason)
+                                  : decode_image(source.c_str(), width, height, channels, status, reason);
+        }
+        else
+        {
+            img = options.sandbox ? decode_image_from_memory_sandboxed(input, header.input_bytes, width, height,
+                                                                       channels, status, reason)
+                                  : decode_image_from_memory(input, header.input_bytes, width, height, channels,
+                                                             status, reason);
+        }
+        if (img == nullptr)
+            return send_error(out_fd, out_socket, SERVICE_DECODE_FAILED, "cannot decode " + source + ": " + reason);
+    }
+
+    // Pack a crop to the start of the buffer, as process_image does
+    ImageView view = pipeline->run(ImageView(img, width, height, channels));
+    for (int y = 0; y < view.height; y++)
+        memmove(img + static_cast<size_t>(y) * view.row_bytes(), view.row(y), view.row_bytes());
+    width = view.width;
+    height = view.height;
+
+    ResponseHeader response = {};
+    memcpy(response.magic, RESPONSE_MAGIC, 4);
+    response.status = SERVICE_OK;
+    response.width = width;
+    response.height = height;
+    response.channels = channels;
+    response.format = format;
+
+    const unsigned char *payload = nullptr;
+    if (!output.empty())
+    {
+        if (!write_output(output, format, width, height, channels, img, quality))
+        {
+            if (!raw)
+                stbi_image_free(img);
+            return send_error(out_fd, out_socket, SERVICE_WRITE_FAILED, "cannot write " + output);
+        }
+    }
+    else if (format == OUTPUT_RAW)
+    {
+        payload = img;
+        response.payload_bytes = static_cast<uint64_t>(width) * height * channels;
+    }
+    else
+    {
+        worker.encoded.clear();
+        if (format == OUTPUT_PNG)
+            stbi_write_png_to_func(append_bytes, &worker.encoded, width, height, channels, img, width * channels);
+        else
+            stbi_write_jpg_to_func(append_bytes, &worker.encoded, width, height, channels, img, quality);
+        payload = worker.encoded.data();
+        response.payload_bytes = worker.encoded.size();
+    }
+
+    const bool sent =
+        write_all(out_fd, out_socket, &response, sizeof(response)) &&
+        write_all(out_fd, out_socket, payload, response.payload_bytes);
+    if (!raw)
+        stbi_image_free(img);
+    return sent;
+}
+
+static void worker_thread(int epoll_fd, int listen_fd, const ServiceOptions *options, int omp_threads)
+{
+    omp_set_num_threads(omp_threads);
+    Worker worker;
+    while (!stop_requested)
+    {
+        epoll_event event;
+        if (epoll_wait(epoll_fd, &event, 1, 200) != 1)
+            continue; // timeout or signal: check for shutdown
+
+        const int fd = event.data.fd;
+        if (fd == listen_fd)
+        {
+            const int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0)
+                continue; // another worker took it
+            timeval timeout = {RECEIVE_TIMEOUT_SECONDS, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            epoll_event armed = {};
+            armed.events = EPOLLIN | EPOLLONESHOT;
+            armed.data.fd = client;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &armed);
+            continue;
+        }
+
+        // One-shot: no other worker sees this connection until it is re-armed
+        if (serve_request(fd, fd, true, worker, *options))
+        {
+            epoll_event armed = {};
+            armed.events = EPOLLIN | EPOLLONESHOT;
+            armed.data.fd = fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &armed);
+        }
+        else
+        {
+            close(fd);
+        }
+    }
+}
+
+bool run_service(const string &socket_path, const ServiceOptions &options, string &error)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path))
+    {
+        error = "invalid socket path '" + socket_path + "'";
+        return false;
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listen_fd < 0)
+    {
+        error = string("socket: ") + strerror(errno);
+        return false;
+    }
+    unlink(socket_path.c_str()); // stale socket of a previous run
+    // Owner only (see service.h); nobody can connect before listen()
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        chmod(socket_path.c_str(), 0600) != 0 || listen(listen_fd, 128) != 0)
+    {
+        error = socket_path + ": " + strerror(errno);
+        close(listen_fd);
+        return false;
+    }
+
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLEXCLUSIVE; // wake one worker per connection
+    event.data.fd = listen_fd;
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0)
+    {
+        error = string("epoll: ") + strerror(errno);
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        return false;
+    }
+
+    // No SA_RESTART, so a signal also cuts epoll_wait short
+    stop_requested = 0;
+    struct sigaction action = {};
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    const int workers = options.workers > 0 ? options.workers : max(1, static_cast<int>(thread::hardware_concurrency()));
+    const int omp_threads = max(1, omp_get_max_threads() / workers);
+    vector<thread> threads;
+    for (int i = 0; i < workers; i++)
+        threads.emplace_back(worker_thread, epoll_fd, listen_fd, &options, omp_threads);
+    for (thread &t : threads)
+        t.join();
+
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    return true;
+}
+
+size_t run_stream(int in_fd, int out_fd, const ServiceOptions &options)
+{
+    struct stat info;
+    const bool out_socket = fstat(out_fd, &info) == 0 && S_ISSOCK(info.st_mode);
+    Worker worker;
+    size_t served = 0;
+    while (serve_request(in_fd, out_fd, out_socket, worker, options))
+        served++;
+    return served;
+}
+
+int connect_service(const string &socket_path, string &error)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path))
+    {
+        error = "invalid socket path '" + socket_path + "'";
+        return -1;
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        error = socket_path + ": " + strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool send_request(int fd, RequestHeader header, const string &spec, const void *input, size_t input_bytes,
+                  const string &output)
+{
+    memcpy(header.magic, REQUEST_MAGIC, 4);
+    header.spec_bytes = static_cast<uint32_t>(spec.size());
+    header.input_bytes = static_cast<uint32_t>(input_bytes);
+    header.output_bytes = static_cast<uint32_t>(output.size());
+    return write_all(fd, true, &header, sizeof(header)) && write_all(fd, true, spec.data(), spec.size()) &&
+           write_all(fd, true, input, input_bytes) && write_all(fd, true, output.data(), output.size());
+}
+
+bool read_response(int fd, ResponseHeader &header, vector<unsigned char> &payload)
+{
+    if (!read_all(fd, &header, sizeof(header)) || memcmp(header.magic, RESPONSE_MAGIC, 4) != 0)
+        return false;
+    payload.resize(header.payload_bytes);
+    return read_all(fd, payload.data(), payload.size());
+}
+
+#endif
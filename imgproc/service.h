@@ -0,0 +1,122 @@
+#ifndef IMGPROC_SERVICE_H
+#define IMGPROC_SERVICE_H
+
+#include "pipeline.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Local preprocessing service. net1.exe --serve PATH listens on a Unix domain
+// socket and runs pipelines for clients (loadgen.exe, or anything speaking
+// the protocol below), so a batch does not pay process start-up and cold
+// caches: the worker threads, their I/O buffers, parsed pipelines and the
+// Gaussian kernel cache all live as long as the service.
+//
+// A connection carries any number of request / response pairs, one at a
+// time. All integers are little-endian. net1.exe --stream speaks the same
+// protocol over stdin / stdout, so it can sit in a shell pipeline.
+//
+//     request   RequestHeader, then spec_bytes + input_bytes + output_bytes:
+//       spec    pipeline text (pipeline.h), empty for the service's pipeline
+//       input   a path the service reads (REQUEST_PATH), a FrameHeader and
+//               raw pixels (REQUEST_RAW, rows packed) or the encoded image
+//       output  a path the service writes the result to, or empty to get it
+//               back in the response
+//     response  ResponseHeader, then payload_bytes of payload: the encoded
+//               image, raw pixels (OUTPUT_RAW, rows packed), nothing when it
+//               was written to a path, or the error message if status != 0
+//
+// Trust model: a client acts with the service's file permissions, since it
+// can name any path to read (REQUEST_PATH) or write (output). The socket is
+// therefore created owner-only (0600); only processes of the same user (or
+// root) can connect. Give other users access through a directory they can
+// reach, not by loosening the socket, and only if they may read and write
+// what the service can. With --stream the same holds for whoever writes stdin.
+
+const char REQUEST_MAGIC[4] = {'I', 'M', 'G', 'Q'};
+const char RESPONSE_MAGIC[4] = {'I', 'M', 'G', 'A'};
+
+enum RequestFlags : uint32_t
+{
+    REQUEST_PATH = 1, // input is a path, not image bytes
+    REQUEST_RAW = 2   // input is a FrameHeader and raw pixels, not an encoded image
+};
+
+enum OutputFormat : uint32_t
+{
+    OUTPUT_JPEG = 0,
+    OUTPUT_PNG = 1,
+    OUTPUT_RAW = 2
+};
+
+enum ServiceStatus : int32_t
+{
+    SERVICE_OK = 0,
+    SERVICE_BAD_REQUEST = 1,
+    SERVICE_BAD_PIPELINE = 2,
+    SERVICE_DECODE_FAILED = 3,
+    SERVICE_WRITE_FAILED = 4
+};
+
+struct RequestHeader
+{
+    char magic[4];    // REQUEST_MAGIC
+    uint32_t flags;   // RequestFlags
+    uint32_t format;  // OutputFormat
+    uint32_t quality; // JPEG quality, 1..100
+    uint32_t spec_bytes;
+    uint32_t input_bytes;
+    uint32_t output_bytes;
+    uint32_t reserved;
+};
+
+struct ResponseHeader
+{
+    char magic[4];   // RESPONSE_MAGIC
+    int32_t status;  // ServiceStatus
+    uint32_t width;  // of the result
+    uint32_t height;
+    uint32_t channels;
+    uint32_t format; // OutputFormat of the payload
+    uint64_t payload_bytes;
+};
+
+struct FrameHeader
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels; // 1..4
+    uint32_t reserved;
+};
+
+static_assert(sizeof(FrameHeader) == 16, "FrameHeader layout is part of the protocol");
+static_assert(sizeof(RequestHeader) == 32, "RequestHeader layout is part of the protocol");
+static_assert(sizeof(ResponseHeader) == 32, "ResponseHeader layout is part of the protocol");
+
+struct ServiceOptions
+{
+    Pipeline pipeline;      // used when a request has no spec
+    int workers = 0;        // 0 for one per core
+    int max_request_mb = 64;
+    bool sandbox = false;   // decode in a child process (decode.h)
+};
+
+// Serve until SIGINT / SIGTERM. Every worker waits on the same epoll set and
+// handles one request at a time, so any number of idle connections share
+// the workers; OpenMP threads are split evenly between them. Returns false
+// with `error` if the socket cannot be set up.
+bool run_service(const std::string &socket_path, const ServiceOptions &options, std::string &error);
+
+// Serve requests read from in_fd, writing the responses to out_fd, until
+// in_fd ends. Requests are handled in order, each pipeline pass spread over
+// all OpenMP threads. Returns the number of requests served.
+size_t run_stream(int in_fd, int out_fd, const ServiceOptions &options);
+
+// Client side
+int connect_service(const std::string &socket_path, std::string &error);
+bool send_request(int fd, RequestHeader header, const std::string &spec, const void *input, size_t input_bytes,
+                  const std::string &output);
+bool read_response(int fd, ResponseHeader &header, std::vector<unsigned char> &payload);
+
+#endif
@@ -0,0 +1,167 @@
+#include "shared_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static SlotHeader *slot_at(const SharedRing &ring, uint64_t sequence)
+{
+    unsigned char *base = reinterpret_cast<unsigned char *>(ring.header);
+    return reinterpret_cast<SlotHeader *>(base + ring.header->data_offset +
+                                          (sequence % ring.header->slot_count) * ring.header->slot_bytes);
+}
+
+#if defined(_WIN32)
+
+bool create_shared_ring(const string &name, int, size_t, SharedRing &, string &error)
+{
+    error = "shared memory rings need POSIX shm_open, not available for " + name;
+    return false;
+}
+
+void close_shared_ring(SharedRing &)
+{
+}
+
+#else
+
+bool create_shared_ring(const string &name, int slots, size_t payload_bytes, SharedRing &ring, string &error)
+{
+    if (slots < 1 || name.size() < 2 || name[0] != '/')
+    {
+        error = "invalid ring '" + name + "' (the name starts with '/' and there is at least one slot)";
+        return false;
+    }
+
+    // Slots start on cache lines so the headers never share one
+    const uint64_t slot_bytes = (sizeof(SlotHeader) + payload_bytes + 63) / 64 * 64;
+    const size_t total = sizeof(RingHeader) + slot_bytes * slots;
+
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        error = "shm_open " + name + ": " + strerror(errno);
+        return false;
+    }
+    void *mapped = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(total)) == 0)
+        mapped = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        error = "mapping " + name + ": " + strerror(errno);
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    close(fd);
+
+    // A new segment is zero-filled, so every slot starts with sequence 0
+    RingHeader *header = static_cast<RingHeader *>(mapped);
+    header->version = RING_VERSION;
+    header->slot_count = static_cast<uint32_t>(slots);
+    header->slot_bytes = slot_bytes;
+    header->data_offset = sizeof(RingHeader);
+    // The magic goes last: a reader that sees it sees a complete header
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, RING_MAGIC, sizeof(RING_MAGIC));
+
+    ring.name = name;
+    ring.header = header;
+    ring.mapped_bytes = total;
+    return true;
+}
+
+void close_shared_ring(SharedRing &ring)
+{
+    if (ring.header == nullptr)
+        return;
+    __atomic_store_n(&ring.header->closed, 1u, __ATOMIC_RELEASE);
+    // With no reader to drain it (none consumed anything, or it stopped),
+    // nobody else would remove the segment from /dev/shm
+    if (ring.reader_lost || __atomic_load_n(&ring.header->read_sequence, __ATOMIC_ACQUIRE) == 0)
+        shm_unlink(ring.name.c_str());
+    munmap(ring.header, ring.mapped_bytes);
+    ring.header = nullptr;
+}
+
+#endif
+
+// Wait for a free slot, fill its header and let `write` fill the payload,
+// then publish it
+template <typename Write>
+static bool publish(SharedRing &ring, int width, int height, int channels, TensorType type, const string &name,
+                    string &error, Write write)
+{
+    const uint64_t payload_bytes = static_cast<uint64_t>(width) * height * channels * tensor_element_bytes(type);
+    if (sizeof(SlotHeader) + payload_bytes > ring.header->slot_bytes)
+    {
+        error = name + " needs " + to_string(payload_bytes) + " bytes, more than a ring slot holds";
+        return false;
+    }
+
+    if (ring.reader_lost)
+    {
+        error = "no reader is consuming " + ring.name;
+        return false;
+    }
+
+    // Wait for the reader to free the slot. The header fields are shared with
+    // another process, so they are accessed with the GCC atomic builtins.
+    const uint64_t sequence = __atomic_load_n(&ring.header->write_sequence, __ATOMIC_RELAXED);
+    const auto deadline = chrono::steady_clock::now() + chrono::milliseconds(ring.reader_timeout_ms);
+    while (sequence - __atomic_load_n(&ring.header->read_sequence, __ATOMIC_ACQUIRE) >= ring.header->slot_count)
+    {
+        if (chrono::steady_clock::now() > deadline)
+        {
+            ring.reader_lost = true;
+            error = "no reader freed a slot of " + ring.name + " within " + to_string(ring.reader_timeout_ms) + " ms";
+            return false;
+        }
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+
+    SlotHeader *slot = slot_at(ring, sequence);
+    slot->width = static_cast<uint32_t>(width);
+    slot->height = static_cast<uint32_t>(height);
+    slot->channels = static_cast<uint32_t>(channels);
+    slot->type = type;
+    slot->payload_bytes = payload_bytes;
+    const size_t name_bytes = min(name.size(), sizeof(slot->name) - 1);
+    memcpy(slot->name, name.data(), name_bytes);
+    slot->name[name_bytes] = '\0';
+    slot->name_bytes = static_cast<uint32_t>(name_bytes);
+
+    write(reinterpret_cast<unsigned char *>(slot + 1));
+
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring.header->write_sequence, sequence + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool publish_image(SharedRing &ring, const ImageView &img, const string &name, string &error)
+{
+    return publish(ring, img.width, img.height, img.channels, TENSOR_UINT8, name, error, [&](unsigned char *payload) {
+        for (int y = 0; y < img.height; y++)
+            memcpy(payload + static_cast<size_t>(y) * img.row_bytes(), img.row(y), img.row_bytes());
+    });
+}
+
+bool publish_tensor(SharedRing &ring, const void *data, int width, int height, int channels, TensorType type,
+                    const string &name, string &error)
+{
+    const size_t bytes = static_cast<size_t>(width) * height * channels * tensor_element_bytes(type);
+    return publish(ring, width, height, channels, type, name, error,
+                   [&](unsigned char *payload) { memcpy(payload, data, bytes); });
+}
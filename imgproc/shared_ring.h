@@ -0,0 +1,94 @@
+#ifndef IMGPROC_SHARED_RING_H
+#define IMGPROC_SHARED_RING_H
+
+#include "image_view.h"
+#include "tensor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Single-producer / single-consumer ring of tensors in POSIX shared memory
+// (shm_open), so a reader in another process (Classifier/shared_ring.py
+// maps it with numpy) gets preprocessed images without files or JPEG
+// encoding. All fields are little-endian and naturally aligned.
+//
+// Segment layout:
+//
+//     offset 0             RingHeader (128 bytes)
+//     data_offset          slot 0: SlotHeader (256 bytes), then payload
+//     + slot_bytes         slot 1 ...
+//
+// Protocol, with sequence numbers counting tensors from 0:
+//  - the writer waits until write_sequence - read_sequence < slot_count,
+//    fills slot (s % slot_count), stores slot.sequence = s + 1 and then
+//    write_sequence = s + 1;
+//  - the reader waits until slot (r % slot_count) has sequence == r + 1,
+//    copies the payload, then stores read_sequence = r + 1;
+//  - after the last tensor the writer sets `closed`. The reader stops once
+//    it has read write_sequence tensors of a closed ring and removes the
+//    segment.
+// The writer only publishes a slot after its payload is written, so the
+// reader never sees a partial tensor.
+
+const char RING_MAGIC[8] = {'I', 'M', 'G', 'R', 'I', 'N', 'G', '\0'};
+const uint32_t RING_VERSION = 1;
+
+struct RingHeader
+{
+    char magic[8];           // RING_MAGIC
+    uint32_t version;        // RING_VERSION
+    uint32_t slot_count;
+    uint64_t slot_bytes;     // stride between slots, SlotHeader included
+    uint64_t data_offset;    // offset of slot 0
+    uint64_t write_sequence; // tensors published
+    uint64_t read_sequence;  // tensors consumed
+    uint32_t closed;         // no more tensors will be published
+    uint8_t reserved[76];
+};
+
+struct SlotHeader
+{
+    uint64_t sequence; // s + 1 once tensor s is in the slot
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t type;          // TensorType
+    uint64_t payload_bytes; // width * height * channels * element size, rows packed
+    uint32_t name_bytes;
+    uint8_t reserved[28];
+    char name[192]; // source path, NUL-terminated (truncated if longer)
+};
+
+static_assert(sizeof(RingHeader) == 128, "RingHeader layout is part of the format");
+static_assert(sizeof(SlotHeader) == 256, "SlotHeader layout is part of the format");
+
+struct SharedRing
+{
+    std::string name;
+    RingHeader *header = nullptr;
+    size_t mapped_bytes = 0;
+    int reader_timeout_ms = 30000; // longest wait for a free slot
+    bool reader_lost = false;      // a wait timed out; later publishes fail at once
+};
+
+// Create (replacing a stale segment of the same name) a ring of `slots`
+// slots holding up to `payload_bytes` each. `name` starts with '/'.
+bool create_shared_ring(const std::string &name, int slots, size_t payload_bytes, SharedRing &ring, std::string &error);
+
+// Publish a tensor, waiting while the ring is full. Fails if it does not fit
+// a slot, or if no reader frees a slot within reader_timeout_ms (none
+// attached, or it died); every publish after that fails without waiting.
+// publish_image packs the rows of `img` as a TENSOR_UINT8 tensor;
+// publish_tensor copies `data` (packed rows of `type` elements).
+bool publish_image(SharedRing &ring, const ImageView &img, const std::string &name, std::string &error);
+bool publish_tensor(SharedRing &ring, const void *data, int width, int height, int channels, TensorType type,
+                    const std::string &name, std::string &error);
+
+// Mark the ring closed and unmap it. The reader removes the segment once it
+// has drained it; if it never consumed a tensor, or was given up on after
+// reader_timeout_ms, the segment is removed here (a reader already attached
+// keeps its mapping, one opening later finds nothing).
+void close_shared_ring(SharedRing &ring);
+
+#endif
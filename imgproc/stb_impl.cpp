@@ -0,0 +1,7 @@
+// The single translation unit that instantiates stb_image and stb_image_write.
+// Tools include the headers without the *_IMPLEMENTATION defines and link this.
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../stb_image_write.h"
@@ -0,0 +1,88 @@
+#ifndef IMGPROC_STENCIL_H
+#define IMGPROC_STENCIL_H
+
+#include <utility>
+
+// Compile-time specialisation of stencil kernels.
+//
+// A kernel is a struct with `template <int C, int R> static void run(...)`.
+// C is the channel count and R the radius; 0 means "not known at compile
+// time", in which case run() reads the runtime value it is passed. Writing
+// each core once as `const int c = C ? C : channels;` lets the specialised
+// instantiations unroll and vectorise while <0, 0> is the generic fallback.
+//
+// dispatch_stencil() picks run<C, R> for C in {1, 3, 4} and R in
+// {1, 2, 3, 5, 10}, falling back to 0 for anything else.
+
+template <typename Kernel, int C, typename... Args>
+void dispatch_radius(int radius, Args &&...args)
+{
+    switch (radius)
+    {
+    case 1:
+        Kernel::template run<C, 1>(std::forward<Args>(args)...);
+        return;
+    case 2:
+        Kernel::template run<C, 2>(std::forward<Args>(args)...);
+        return;
+    case 3:
+        Kernel::template run<C, 3>(std::forward<Args>(args)...);
+        return;
+    case 5:
+        Kernel::template run<C, 5>(std::forward<Args>(args)...);
+        return;
+    case 10:
+        Kernel::template run<C, 10>(std::forward<Args>(args)...);
+        return;
+    default:
+        Kernel::template run<C, 0>(std::forward<Args>(args)...);
+    }
+}
+
+template <typename Kernel, typename... Args>
+void dispatch_stencil(int channels, int radius, Args &&...args)
+{
+    switch (channels)
+    {
+    case 1:
+        dispatch_radius<Kernel, 1>(radius, std::forward<Args>(args)...);
+        return;
+    case 3:
+        dispatch_radius<Kernel, 3>(radius, std::forward<Args>(args)...);
+        return;
+    case 4:
+        dispatch_radius<Kernel, 4>(radius, std::forward<Args>(args)...);
+        return;
+    default:
+        dispatch_radius<Kernel, 0>(radius, std::forward<Args>(args)...);
+    }
+}
+
+// For fixed-radius kernels (3x3): specialise on the channel count only
+template <typename Kernel, typename... Args>
+void dispatch_channels(int channels, Args &&...args)
+{
+    switch (channels)
+    {
+    case 1:
+        Kernel::template run<1, 1>(std::forward<Args>(args)...);
+        return;
+    case 3:
+        Kernel::template run<3, 1>(std::forward<Args>(args)...);
+        return;
+    case 4:
+        Kernel::template run<4, 1>(std::forward<Args>(args)...);
+        return;
+    default:
+        Kernel::template run<0, 1>(std::forward<Args>(args)...);
+    }
+}
+
+// Multiplier for exact division by `divisor` of any value below 2^32 / divisor:
+// n / divisor == (n * reciprocal_u32(divisor)) >> 32
+constexpr unsigned long long reciprocal_u32(unsigned divisor)
+{
+    return ((1ULL << 32) + divisor - 1) / divisor;
+}
+
+#endif
@@ -0,0 +1,238 @@
+#include "tensor.h"
+
+#include <omp.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Values per step of the vector loop: three vectors of 8, a multiple of every
+// channel count from 1 to 4, so each step starts on channel 0
+static const int PATTERN = 24;
+
+size_t tensor_element_bytes(TensorType type)
+{
+    switch (type)
+    {
+    case TENSOR_FLOAT32:
+        return 4;
+    case TENSOR_FLOAT16:
+    case TENSOR_BFLOAT16:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+static bool parse_list(const string &s, vector<float> &values)
+{
+    values.clear();
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        char *end;
+        float v = strtof(item.c_str(), &end);
+        if (item.empty() || *end != '\0')
+            return false;
+        values.push_back(v);
+    }
+    return true;
+}
+
+bool parse_tensor_format(const string &type, const string &mean, const string &std, TensorFormat &format, string &error)
+{
+    if (type == "f32")
+        format.type = TENSOR_FLOAT32;
+    else if (type == "f16")
+        format.type = TENSOR_FLOAT16;
+    else if (type == "bf16")
+        format.type = TENSOR_BFLOAT16;
+    else if (type == "u8")
+        format.type = TENSOR_UINT8;
+    else
+    {
+        error = "unknown tensor type '" + type + "' (f32, f16, bf16 or u8)";
+        return false;
+    }
+
+    if (!parse_list(mean, format.mean) || !parse_list(std, format.std))
+    {
+        error = "bad mean / std list";
+        return false;
+    }
+    for (float s : format.std)
+    {
+        if (!(s > 0.0f))
+        {
+            error = "std must be positive";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Round to nearest even, like vcvtps2ph with _MM_FROUND_TO_NEAREST_INT
+static uint16_t float_to_half(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const uint32_t magnitude = x & 0x7FFFFFFF;
+    if (magnitude > 0x7F800000)
+        return static_cast<uint16_t>(sign | 0x7E00); // NaN
+    if (magnitude >= 0x477FF000)
+        return static_cast<uint16_t>(sign | 0x7C00); // rounds to infinity
+
+    uint32_t result;
+    uint32_t remainder, halfway;
+    if (magnitude < 0x38800000)
+    {
+        // Subnormal half: the significand shifted down to units of 2^-24
+        const int shift = 126 - static_cast<int>(magnitude >> 23);
+        if (shift > 24)
+            return static_cast<uint16_t>(sign);
+        const uint32_t significand = (magnitude & 0x7FFFFF) | 0x800000;
+        result = significand >> shift;
+        remainder = significand & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        result = (magnitude - 0x38000000) >> 13;
+        remainder = magnitude & 0x1FFF;
+        halfway = 0x1000;
+    }
+    if (remainder > halfway || (remainder == halfway && (result & 1)))
+        result++;
+    return static_cast<uint16_t>(sign | result);
+}
+
+static uint16_t float_to_bfloat16(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    return static_cast<uint16_t>((x + 0x7FFF + ((x >> 16) & 1)) >> 16);
+}
+
+template <TensorType T>
+static inline void store_scalar(void *out, int i, float v)
+{
+    if (T == TENSOR_FLOAT32)
+        static_cast<float *>(out)[i] = v;
+    else if (T == TENSOR_FLOAT16)
+        static_cast<uint16_t *>(out)[i] = float_to_half(v);
+    else
+        static_cast<uint16_t *>(out)[i] = float_to_bfloat16(v);
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+template <TensorType T>
+static inline void store_vector(void *out, int i, __m256 v)
+{
+    if (T == TENSOR_FLOAT32)
+    {
+        _mm256_storeu_ps(static_cast<float *>(out) + i, v);
+    }
+    else if (T == TENSOR_FLOAT16)
+    {
+#if defined(__F16C__)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(static_cast<uint16_t *>(out) + i),
+                         _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+#else
+        float values[8];
+        _mm256_storeu_ps(values, v);
+        for (int k = 0; k < 8; k++)
+            static_cast<uint16_t *>(out)[i + k] = float_to_half(values[k]);
+#endif
+    }
+    else
+    {
+        __m256i x = _mm256_castps_si256(v);
+        __m256i odd = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1));
+        x = _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_add_epi32(odd, _mm256_set1_epi32(0x7FFF))), 16);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(x, x), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(static_cast<uint16_t *>(out) + i), _mm256_castsi256_si128(packed));
+    }
+}
+#endif
+
+// One row: n values, scale / offset repeating with period PATTERN
+template <TensorType T>
+static void convert_row(const unsigned char *in, void *out, int n, const float *scale, const float *offset)
+{
+    int i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 a[3], b[3];
+    for (int k = 0; k < 3; k++)
+    {
+        a[k] = _mm256_loadu_ps(scale + 8 * k);
+        b[k] = _mm256_loadu_ps(offset + 8 * k);
+    }
+    for (; i + PATTERN <= n; i += PATTERN)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i + 8 * k));
+            __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+            store_vector<T>(out, i + 8 * k, _mm256_fmadd_ps(v, a[k], b[k]));
+        }
+    }
+#endif
+    for (; i < n; i++)
+    {
+        store_scalar<T>(out, i, fmaf(static_cast<float>(in[i]), scale[i % PATTERN], offset[i % PATTERN]));
+    }
+}
+
+template <TensorType T>
+static void convert_rows(const ImageView &src, void *dst, const float *scale, const float *offset)
+{
+    const int n = src.row_bytes();
+#pragma omp parallel for
+    for (int y = 0; y < src.height; y++)
+    {
+        void *out = static_cast<unsigned char *>(dst) + static_cast<size_t>(y) * n * tensor_element_bytes(T);
+        convert_row<T>(src.row(y), out, n, scale, offset);
+    }
+}
+
+void convert_to_tensor(const ImageView &src, void *dst, const TensorFormat &format)
+{
+    if (format.type == TENSOR_UINT8)
+    {
+        for (int y = 0; y < src.height; y++)
+            memcpy(static_cast<unsigned char *>(dst) + static_cast<size_t>(y) * src.row_bytes(), src.row(y), src.row_bytes());
+        return;
+    }
+
+    // (v / 255 - mean) / std as one multiply-add per value
+    float scale[PATTERN], offset[PATTERN];
+    for (int i = 0; i < PATTERN; i++)
+    {
+        const int ch = i % src.channels;
+        const float mean = ch < static_cast<int>(format.mean.size()) ? format.mean[ch] : 0.0f;
+        const float std = ch < static_cast<int>(format.std.size()) ? format.std[ch] : 1.0f;
+        scale[i] = 1.0f / (255.0f * std);
+        offset[i] = -mean / std;
+    }
+
+    switch (format.type)
+    {
+    case TENSOR_FLOAT16:
+        convert_rows<TENSOR_FLOAT16>(src, dst, scale, offset);
+        break;
+    case TENSOR_BFLOAT16:
+        convert_rows<TENSOR_BFLOAT16>(src, dst, scale, offset);
+        break;
+    default:
+        convert_rows<TENSOR_FLOAT32>(src, dst, scale, offset);
+        break;
+    }
+}
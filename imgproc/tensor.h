@@ -0,0 +1,41 @@
+#ifndef IMGPROC_TENSOR_H
+#define IMGPROC_TENSOR_H
+
+#include "image_view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Element types of model input tensors (also the type codes of shared_ring.h)
+enum TensorType : uint32_t
+{
+    TENSOR_UINT8 = 0,
+    TENSOR_FLOAT32 = 1,
+    TENSOR_FLOAT16 = 2,  // IEEE half, round to nearest even
+    TENSOR_BFLOAT16 = 3, // upper half of a float32, round to nearest even
+};
+
+size_t tensor_element_bytes(TensorType type);
+
+// out = (in / 255 - mean[ch]) / std[ch], the Keras rescale=1./255 when mean
+// and std are empty. TENSOR_UINT8 copies the pixels unchanged.
+struct TensorFormat
+{
+    TensorType type = TENSOR_FLOAT32;
+    std::vector<float> mean; // one per channel, or empty for 0
+    std::vector<float> std;  // one per channel (> 0), or empty for 1
+};
+
+// "f32", "f16", "bf16" or "u8", and comma separated per-channel lists such
+// as "0.485,0.456,0.406" (either may be empty)
+bool parse_tensor_format(const std::string &type, const std::string &mean, const std::string &std, TensorFormat &format,
+                         std::string &error);
+
+// Convert src into dst, whose rows are packed (width * channels elements).
+// AVX2 + FMA (and F16C for float16) with a scalar tail that gives the same
+// values.
+void convert_to_tensor(const ImageView &src, void *dst, const TensorFormat &format);
+
+#endif
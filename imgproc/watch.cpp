@@ -0,0 +1,221 @@
+#include "watch.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#if defined(_WIN32)
+
+bool watch_directory(const string &root, const function<void(const string &)> &, string &error)
+{
+    error = "watching needs inotify, not available for " + root;
+    return false;
+}
+
+#else
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+// Where leases are unavailable, a file found in a new directory is reported
+// once it has not been written for this long
+static const int QUIET_MS = 500;
+
+struct Watch
+{
+    int fd;
+    map<int, string> directories; // watch descriptor -> path
+    set<string> pending;          // files found by a scan, not reported yet
+    const function<void(const string &)> *on_file;
+};
+
+static const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+// Watch `path` and its subdirectories. With `report`, files already there
+// become pending: they may have been written before the watch existed, or
+// still be open, in which case their IN_CLOSE_WRITE is still to come.
+static void add_tree(Watch &watch, const string &path, bool report)
+{
+    const int wd = inotify_add_watch(watch.fd, path.c_str(), WATCH_EVENTS);
+    if (wd < 0)
+    {
+        cerr << "Cannot watch " << path << ": " << strerror(errno) << endl;
+        return;
+    }
+    watch.directories[wd] = path;
+
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return;
+    vector<string> subdirectories;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        const string name = entry->d_name;
+        if (name[0] == '.')
+            continue;
+        struct stat info;
+        const string child = path + "/" + name;
+        if (lstat(child.c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            subdirectories.push_back(child);
+        else if (S_ISREG(info.st_mode) && report)
+            watch.pending.insert(child);
+    }
+    closedir(dir);
+
+    for (const string &child : subdirectories)
+        add_tree(watch, child, report);
+}
+
+// 1 if nobody has `path` open for writing, 0 if someone has, -1 if unknown.
+// A read lease is refused (EAGAIN) while the file is open for writing.
+static int closed_for_writing(const string &path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+    int closed = -1;
+    if (fcntl(fd, F_SETLEASE, F_RDLCK) == 0)
+    {
+        fcntl(fd, F_SETLEASE, F_UNLCK);
+        closed = 1;
+    }
+    else if (errno == EAGAIN)
+    {
+        closed = 0;
+    }
+    close(fd);
+    return closed;
+}
+
+// Report the pending files nobody is writing. A file still open stays
+// pending until its IN_CLOSE_WRITE; without leases (another user's file),
+// one unmodified for QUIET_MS counts as complete.
+static void report_pending(Watch &watch)
+{
+    const auto now = chrono::system_clock::now();
+    for (auto it = watch.pending.begin(); it != watch.pending.end();)
+    {
+        struct stat info;
+        if (stat(it->c_str(), &info) != 0)
+        {
+            it = watch.pending.erase(it); // removed meanwhile
+            continue;
+        }
+        const int closed = closed_for_writing(*it);
+        const auto modified = chrono::system_clock::time_point(chrono::duration_cast<chrono::system_clock::duration>(
+            chrono::seconds(info.st_mtim.tv_sec) + chrono::nanoseconds(info.st_mtim.tv_nsec)));
+        if (closed == 0 || (closed < 0 && now - modified < chrono::milliseconds(QUIET_MS)))
+        {
+            ++it;
+            continue;
+        }
+        const string path = *it;
+        it = watch.pending.erase(it);
+        (*watch.on_file)(path);
+    }
+}
+
+static void handle_event(Watch &watch, const inotify_event &event)
+{
+    if (event.mask & IN_Q_OVERFLOW)
+    {
+        cerr << "inotify queue overflowed; some new files were missed" << endl;
+        return;
+    }
+    if (event.mask & IN_IGNORED)
+    {
+        watch.directories.erase(event.wd); // directory removed
+        return;
+    }
+    auto it = watch.directories.find(event.wd);
+    if (it == watch.directories.end() || event.len == 0 || event.name[0] == '.')
+        return;
+
+    const string path = it->second + "/" + event.name;
+    if (event.mask & IN_ISDIR)
+    {
+        if (event.mask & (IN_CREATE | IN_MOVED_TO))
+            add_tree(watch, path, true);
+    }
+    else if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+    {
+        watch.pending.erase(path);
+        (*watch.on_file)(path);
+    }
+}
+
+bool watch_directory(const string &root, const function<void(const string &)> &on_file, string &error)
+{
+    Watch watch;
+    watch.fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    watch.on_file = &on_file;
+    if (watch.fd < 0)
+    {
+        error = string("inotify_init1: ") + strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (stat(root.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+    {
+        error = root + " is not a directory";
+        close(watch.fd);
+        return false;
+    }
+    add_tree(watch, root, false);
+
+    // No SA_RESTART, so a signal also cuts poll short
+    stop_requested = 0;
+    struct sigaction action = {};
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    alignas(inotify_event) char buffer[64 * 1024];
+    pollfd readable = {watch.fd, POLLIN, 0};
+    while (!stop_requested)
+    {
+        // Events first: a queued close or rename takes a file off the pending list
+        if (poll(&readable, 1, watch.pending.empty() ? 500 : 100) > 0)
+        {
+            ssize_t bytes;
+            while ((bytes = read(watch.fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char *p = buffer; p < buffer + bytes;)
+                {
+                    const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+                    handle_event(watch, *event);
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+        if (!watch.pending.empty())
+            report_pending(watch);
+    }
+    close(watch.fd);
+    return true;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef IMGPROC_WATCH_H
+#define IMGPROC_WATCH_H
+
+#include <functional>
+#include <string>
+
+// Watch `root` and every directory below it (including ones created later)
+// with inotify, calling on_file(path) for each file that lands there, until
+// SIGINT / SIGTERM. A file counts once it is complete:
+//  - IN_CLOSE_WRITE: the writer closed it, so copies and uploads written in
+//    place are never seen half-written;
+//  - IN_MOVED_TO: renamed in from elsewhere (the usual atomic upload).
+// Names starting with '.' (editor and rsync temporaries) are ignored.
+// Files already inside a directory when it appears (mv or cp -r of a
+// folder) may have had their event before the watch existed. They are
+// reported once nobody has them open for writing (checked with a read
+// lease), else at their close; each file once. Leases need the file's owner
+// or CAP_LEASE: for other files, one unmodified for 500 ms counts as
+// complete, so a writer pausing longer than that could be read early.
+// Returns false with `error` if the watch cannot be set up.
+bool watch_directory(const std::string &root, const std::function<void(const std::string &path)> &on_file,
+                     std::string &error);
+
+#endif
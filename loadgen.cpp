@@ -0,0 +1,155 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "imgproc/service.h"
+
+using namespace std;
+using namespace chrono;
+
+// Load generator for net1.exe --serve: `--concurrency` connections each send
+// requests back to back until `--requests` have been made in total, then the
+// request latencies are summarised as percentiles.
+//
+//     loadgen.exe /tmp/imgproc.sock image.jpg --requests 2000 --concurrency 4
+//
+// --path sends the image path instead of its bytes, --ops the pipeline to
+// run (default: the service's), --png / --raw the response format.
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    const size_t i = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: loadgen.exe SOCKET IMAGE [--requests N] [--concurrency C] [--ops SPEC] [--path] [--png|--raw]"
+                  << std::endl;
+        return -1;
+    }
+    const std::string socket_path = argv[1];
+    const std::string image_path = argv[2];
+    int requests = 1000;
+    int concurrency = 4;
+    std::string spec;
+    bool send_path = false;
+    RequestHeader header = {};
+    header.format = OUTPUT_JPEG;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--requests" && i + 1 < argc)
+            requests = atoi(argv[++i]);
+        else if (arg == "--concurrency" && i + 1 < argc)
+            concurrency = std::max(1, atoi(argv[++i]));
+        else if (arg == "--ops" && i + 1 < argc)
+            spec = argv[++i];
+        else if (arg == "--path")
+            send_path = true;
+        else if (arg == "--png")
+            header.format = OUTPUT_PNG;
+        else if (arg == "--raw")
+            header.format = OUTPUT_RAW;
+    }
+
+    std::vector<unsigned char> input;
+    if (send_path)
+    {
+        char resolved[4096];
+        if (realpath(image_path.c_str(), resolved) == nullptr)
+        {
+            std::cerr << "Cannot resolve " << image_path << std::endl;
+            return -1;
+        }
+        input.assign(resolved, resolved + strlen(resolved));
+        header.flags = REQUEST_PATH;
+    }
+    else
+    {
+        std::ifstream file(image_path, std::ios::binary);
+        input.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (input.empty())
+        {
+            std::cerr << "Cannot read " << image_path << std::endl;
+            return -1;
+        }
+    }
+
+    std::atomic<int> next(0);
+    std::atomic<int> failed(0);
+    std::atomic<long long> received(0);
+    std::vector<std::vector<double>> latencies(concurrency);
+    std::vector<std::thread> clients;
+    auto start_time = high_resolution_clock::now();
+    for (int c = 0; c < concurrency; c++)
+    {
+        clients.emplace_back(
+            [&, c]
+            {
+                std::string error;
+                const int fd = connect_service(socket_path, error);
+                if (fd < 0)
+                {
+                    std::cerr << "Cannot connect: " << error << std::endl;
+                    return;
+                }
+                ResponseHeader response;
+                std::vector<unsigned char> payload;
+                while (next++ < requests)
+                {
+                    auto sent = high_resolution_clock::now();
+                    if (!send_request(fd, header, spec, input.data(), input.size(), "") ||
+                        !read_response(fd, response, payload))
+                    {
+                        failed++;
+                        break;
+                    }
+                    latencies[c].push_back(duration<double, milli>(high_resolution_clock::now() - sent).count());
+                    if (response.status != SERVICE_OK)
+                    {
+                        if (failed++ == 0)
+                            std::cerr << "Request failed: " << std::string(payload.begin(), payload.end()) << std::endl;
+                    }
+                    received += static_cast<long long>(payload.size());
+                }
+                close(fd);
+            });
+    }
+    for (std::thread &t : clients)
+        t.join();
+    auto end_time = high_resolution_clock::now();
+
+    std::vector<double> all;
+    for (const std::vector<double> &l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    const double seconds = duration<double>(end_time - start_time).count();
+    double total = 0.0;
+    for (double l : all)
+        total += l;
+
+    std::cout << all.size() << " requests over " << concurrency << " connections in " << seconds * 1000.0 << " ms ("
+              << all.size() / seconds << " requests/s, " << failed << " failed, " << received / (1 << 20)
+              << " MB received)" << std::endl;
+    if (!all.empty())
+    {
+        std::cout << "Latency ms: mean " << total / all.size() << ", p50 " << percentile(all, 50) << ", p90 "
+                  << percentile(all, 90) << ", p99 " << percentile(all, 99) << ", p99.9 " << percentile(all, 99.9)
+                  << ", max " << all.back() << std::endl;
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -1,164 +1,103 @@
 #include <iostream>
 #include <omp.h>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
 #include <dirent.h>
+#if defined(_WIN32)
 #include <direct.h>
+#endif
 #include <sys/stat.h>
 #include <chrono>
 #include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <csignal>
+#include <thread>
 
-#define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
+#include "imgproc/batcher.h"
+#include "imgproc/cnn.h"
+#include "imgproc/decode.h"
+#include "imgproc/kernels.h"
+#include "imgproc/pipeline.h"
+#include "imgproc/quantize.h"
+#include "imgproc/service.h"
+#include "imgproc/shared_ring.h"
+#include "imgproc/watch.h"
 
 using namespace std;
 using namespace chrono;
 
-// Grayscale conversion
-void apply_grayscale(unsigned char *img, int width, int height, int channels)
+// Create one directory level (an existing one is fine)
+int make_directory(const char *path)
 {
-#pragma omp parallel for
-    for (int i = 0; i < width * height; i++)
-    {
-        int r = img[i * channels];
-        int g = img[i * channels + 1];
-        int b = img[i * channels + 2];
-        unsigned char gray = 0.3 * r + 0.59 * g + 0.11 * b;
-        img[i * channels] = img[i * channels + 1] = img[i * channels + 2] = gray;
-    }
+#if defined(_WIN32)
+    return _mkdir(path);
+#else
+    return mkdir(path, 0755);
+#endif
 }
 
-// Gaussian Blur
-void apply_gaussian_blur(unsigned char *img, int width, int height, int channels)
+// Preprocessing stages, set from --ops / --pipeline / --crop-lesion in main
+Pipeline pipeline;
+std::atomic<long long> decoded_pixels(0);
+std::atomic<long long> processed_pixels(0);
+
+// --shm NAME: publish the processed images to a shared-memory ring instead of writing JPEGs
+SharedRing ring;
+bool streaming = false;
+// --tensor TYPE [--mean m0,m1,m2] [--std s0,s1,s2]: stream model-ready tensors instead of uint8 images
+TensorFormat tensor_format;
+bool tensor_output = false;
+// --classify MODEL.bin [--scores FILE]: score each processed image with the native CNN instead of writing JPEGs,
+// in micro-batches of up to --batch N images held at most --max-latency MS; --int8 N quantises the model first,
+// calibrated on N preprocessed images spread over the dataset
+Model model;
+std::ofstream scores;
+BatchScheduler *scheduler = nullptr;
+bool classifying = false;
+// --errors FILE: one path,status,reason line per file that failed; --retries N: attempts after a failure that may
+// be transient (anything but a corrupt image); --on-error stop: stop at the first failure instead of skipping the
+// file; --sandbox: decode in a child process, so a file that crashes or hangs the decoder costs only that file
+std::ofstream error_log;
+int retries = 0;
+bool stop_on_error = false;
+bool sandboxed = false;
+std::atomic<int> failed_count(0);
+std::atomic<bool> stop_processing(false);
+
+// With `tensor`, the result is also converted to tensor_format inside the last pass. On failure returns nullptr
+// with `status` and a static `reason`.
+unsigned char *process_image(const char *image_path, int &width, int &height, int &channels, DecodeStatus &status,
+                             const char *&reason, std::vector<unsigned char> *tensor = nullptr)
 {
-    const int kernel_size = 3;
-    const float kernel[3][3] = {
-        {1 / 16.0, 2 / 16.0, 1 / 16.0},
-        {2 / 16.0, 4 / 16.0, 2 / 16.0},
-        {1 / 16.0, 2 / 16.0, 1 / 16.0}};
-
-    unsigned char *output = new unsigned char[width * height * channels];
-
-#pragma omp parallel for collapse(2)
-    for (int y = 1; y < height - 1; y++)
-    {
-        for (int x = 1; x < width - 1; x++)
-        {
-            for (int c = 0; c < channels; c++)
-            {
-                float sum = 0.0;
-                for (int ky = -1; ky <= 1; ky++)
-                {
-                    for (int kx = -1; kx <= 1; kx++)
-                    {
-                        int pixel = img[((y + ky) * width + (x + kx)) * channels + c];
-                        sum += pixel * kernel[ky + 1][kx + 1];
-                    }
-                }
-                output[(y * width + x) * channels + c] = static_cast<unsigned char>(sum);
-            }
-        }
-    }
-
-    memcpy(img, output, width * height * channels);
-    delete[] output;
-}
-
-void apply_sharpening(unsigned char *img, int width, int height, int channels)
-{
-    const int kernel_size = 3;
-    const float kernel[3][3] = {
-        {-1, -1, -1},
-        {-1, 9, -1},
-        {-1, -1, -1}};
-
-    unsigned char *output = new unsigned char[width * height * channels];
-
-#pragma omp parallel for collapse(2)
-    for (int y = 1; y < height - 1; y++)
-    {
-        for (int x = 1; x < width - 1; x++)
-        {
-            for (int c = 0; c < channels; c++)
-            {
-                float sum = 0.0;
-                for (int ky = -1; ky <= 1; ky++)
-                {
-                    for (int kx = -1; kx <= 1; kx++)
-                    {
-                        int pixel = img[((y + ky) * width + (x + kx)) * channels + c];
-                        sum += pixel * kernel[ky + 1][kx + 1];
-                    }
-                }
-                output[(y * width + x) * channels + c] = static_cast<unsigned char>(min(max(sum, 0.0f), 255.0f));
-            }
-        }
-    }
+    unsigned char *img = sandboxed ? decode_image_sandboxed(image_path, width, height, channels, status, reason)
+                                   : decode_image(image_path, width, height, channels, status, reason);
 
-    memcpy(img, output, width * height * channels);
-    delete[] output;
-}
-
-// Histogram Equalization
-void apply_histogram_equalization(unsigned char *img, int width, int height, int channels)
-{
-    int histogram[256] = {0};
-    unsigned char lut[256];
-    int total_pixels = width * height;
+    if (img == nullptr)
+        return nullptr;
 
-// Compute histogram
-#pragma omp parallel for reduction(+ : histogram[ : 256])
-    for (int i = 0; i < total_pixels; i++)
-    {
-        histogram[img[i * channels]]++;
-    }
+    // Apply Preprocessing Steps
+    ImageView view = tensor != nullptr ? pipeline.run(ImageView(img, width, height, channels), tensor_format, *tensor)
+                                       : pipeline.run(ImageView(img, width, height, channels));
+    decoded_pixels += static_cast<long long>(width) * height;
+    processed_pixels += static_cast<long long>(view.width) * view.height;
 
-    // Compute cumulative distribution function (CDF)
-    int cdf_min = 0;
-    for (int i = 0; i < 256; i++)
+    // Pack the crop to the start of the buffer so it can be written as is
+    if (view.width != width || view.height != height)
     {
-        if (histogram[i] > 0)
+        for (int y = 0; y < view.height; y++)
         {
-            cdf_min = histogram[i];
-            break;
+            memmove(img + y * view.row_bytes(), view.row(y), view.row_bytes());
         }
+        width = view.width;
+        height = view.height;
     }
 
-    int cumulative = 0;
-    for (int i = 0; i < 256; i++)
-    {
-        cumulative += histogram[i];
-        lut[i] = static_cast<unsigned char>(round(255.0 * (cumulative - cdf_min) / (total_pixels - cdf_min)));
-    }
-
-// Apply LUT
-#pragma omp parallel for
-    for (int i = 0; i < total_pixels; i++)
-    {
-        img[i * channels] = img[i * channels + 1] = img[i * channels + 2] = lut[img[i * channels]];
-    }
-}
-
-unsigned char *process_image(const char *image_path, int &width, int &height, int &channels)
-{
-    unsigned char *img = stbi_load(image_path, &width, &height, &channels, 0);
-
-    if (img == NULL)
-    {
-        cout << "Error loading image\n";
-        return nullptr;
-    }
-
-    // Apply Preprocessing Steps
-    apply_grayscale(img, width, height, channels);
-    apply_gaussian_blur(img, width, height, channels);
-    apply_sharpening(img, width, height, channels);
-    apply_histogram_equalization(img, width, height, channels);
-
     return img;
 }
 
@@ -235,10 +174,153 @@ unsigned char *process_image(const char *image_path, int &width, int &height, in
 //     return 0;
 // }
 
+// Every regular file under `folder`, sorted
+void list_files(const std::string &folder, std::vector<std::string> &files)
+{
+    DIR *dir = opendir(folder.c_str());
+    if (dir == nullptr)
+        return;
+    std::vector<std::string> names;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        std::string entry_name = entry->d_name;
+        if (entry_name != "." && entry_name != "..")
+            names.push_back(entry_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    for (const std::string &name : names)
+    {
+        std::string path = folder + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            list_files(path, files);
+        else if (S_ISREG(info.st_mode))
+            files.push_back(path);
+    }
+}
+
+// Quantise `model` on `count` images spread evenly over `folder`, preprocessed by the pipeline
+bool calibrate_int8(const std::string &folder, int count, std::string &error)
+{
+    std::vector<std::string> files;
+    list_files(folder, files);
+    count = std::min(count, static_cast<int>(files.size()));
+    const size_t input_size = static_cast<size_t>(model.height) * model.width * model.channels;
+    std::vector<float> inputs(input_size * count);
+    int loaded = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int width, height, channels;
+        DecodeStatus status;
+        const char *reason;
+        const std::string &path = files[static_cast<size_t>(i) * files.size() / count];
+        unsigned char *img = process_image(path.c_str(), width, height, channels, status, reason);
+        if (img == nullptr)
+        {
+            std::cerr << "Skipping calibration image " << path << ": " << reason << std::endl;
+            continue;
+        }
+        prepare_input(model, ImageView(img, width, height, channels), &inputs[input_size * loaded++]);
+        stbi_image_free(img);
+    }
+    // Calibration images are not part of the run's statistics
+    decoded_pixels = 0;
+    processed_pixels = 0;
+    return quantize_model(model, inputs.data(), loaded, error);
+}
+
 // Global counter for processed images
 std::atomic<int> processed_count(0);
 
-void process_directory(const std::string &input_folder, const std::string &output_folder, const auto &start_time)
+// CSV field, quoted (with quotes doubled) when it holds a comma, quote or line break
+std::string csv_field(const std::string &text)
+{
+    if (text.find_first_of(",\"\r\n") == std::string::npos)
+        return text;
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+// Failures only: report, log to --errors and apply --on-error
+void record_failure(const std::string &path, const char *status, const char *reason)
+{
+    ++failed_count;
+    std::cerr << "Error processing image: " << path << " (" << status << ": " << reason << ")" << std::endl;
+    if (error_log.is_open())
+        error_log << csv_field(path) << ',' << status << ',' << csv_field(reason) << '\n';
+    if (stop_on_error)
+        stop_processing = true;
+}
+
+// Process one file and hand the result to the ring, the classifier or a JPEG at output_path
+bool process_file(const std::string &input_path, const std::string &output_path,
+                  const high_resolution_clock::time_point &start_time)
+{
+    int width, height, channels;
+    DecodeStatus status;
+    const char *reason;
+    std::vector<unsigned char> tensor;
+    unsigned char *processed_img =
+        process_image(input_path.c_str(), width, height, channels, status, reason, tensor_output ? &tensor : nullptr);
+
+    // A corrupt image stays corrupt; anything else may be a file still being copied or a decoder that was killed
+    for (int attempt = 1; processed_img == nullptr && status != DECODE_CORRUPT && attempt <= retries; attempt++)
+    {
+        std::this_thread::sleep_for(milliseconds(100 * attempt));
+        processed_img = process_image(input_path.c_str(), width, height, channels, status, reason,
+                                      tensor_output ? &tensor : nullptr);
+    }
+    if (processed_img == nullptr)
+    {
+        record_failure(input_path, decode_status_name(status), reason);
+        return false;
+    }
+
+    std::string error;
+    bool published = true;
+    bool written = true;
+    if (classifying)
+        submit_image(scheduler, input_path, ImageView(processed_img, width, height, channels));
+    if (streaming && tensor_output)
+        published = publish_tensor(ring, tensor.data(), width, height, channels, tensor_format.type, input_path, error);
+    else if (streaming)
+        published = publish_image(ring, ImageView(processed_img, width, height, channels), input_path, error);
+    else if (!classifying)
+        written = stbi_write_jpg(output_path.c_str(), width, height, channels, processed_img, 100) != 0;
+    stbi_image_free(processed_img);
+    if (!published)
+        record_failure(input_path, "stream-failed", error.c_str());
+    if (!written)
+        record_failure(input_path, "write-failed", ("cannot write " + output_path).c_str());
+    if (!published || !written)
+        return false;
+
+    // Increment the global counter
+    int current_count = ++processed_count;
+
+    // Print elapsed time for every 1000 images processed
+    if (current_count % 1000 == 0)
+    {
+        auto current_time = high_resolution_clock::now();
+        auto elapsed_time = duration_cast<milliseconds>(current_time - start_time).count();
+        std::cout << "Time spent after processing " << current_count << " images: " << elapsed_time << " ms" << std::endl;
+    }
+    return true;
+}
+
+void process_directory(const std::string &input_folder, const std::string &output_folder,
+                       const high_resolution_clock::time_point &start_time)
 {
     DIR *dir = opendir(input_folder.c_str());
     if (dir == nullptr)
@@ -248,7 +330,7 @@ void process_directory(const std::string &input_folder, const std::string &outpu
     }
 
     struct dirent *entry;
-    while ((entry = readdir(dir)) != nullptr)
+    while (!stop_processing && (entry = readdir(dir)) != nullptr)
     {
         std::string entry_name = entry->d_name;
 
@@ -265,35 +347,14 @@ void process_directory(const std::string &input_folder, const std::string &outpu
             if (S_ISDIR(info.st_mode))
             {
                 // If it's a directory, recursively process it
-                _mkdir(output_path.c_str()); // Create corresponding output directory
+                if (!streaming && !classifying)
+                    make_directory(output_path.c_str()); // Create corresponding output directory
                 process_directory(input_path, output_path, start_time);
             }
             else if (S_ISREG(info.st_mode))
             {
                 // If it's a file, process it
-                int width, height, channels;
-                unsigned char *processed_img = process_image(input_path.c_str(), width, height, channels);
-
-                if (processed_img != nullptr)
-                {
-                    stbi_write_jpg(output_path.c_str(), width, height, channels, processed_img, 100);
-                    stbi_image_free(processed_img);
-
-                    // Increment the global counter
-                    int current_count = ++processed_count;
-
-                    // Print elapsed time for every 1000 images processed
-                    if (current_count % 1000 == 0)
-                    {
-                        auto current_time = high_resolution_clock::now();
-                        auto elapsed_time = duration_cast<milliseconds>(current_time - start_time).count();
-                        std::cout << "Time spent after processing " << current_count << " images: " << elapsed_time << " ms" << std::endl;
-                    }
-                }
-                else
-                {
-                    std::cerr << "Error processing image: " << input_path << std::endl;
-                }
+                process_file(input_path, output_path, start_time);
             }
         }
     }
@@ -301,23 +362,292 @@ void process_directory(const std::string &input_folder, const std::string &outpu
     closedir(dir);
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    // --ops gray,blur:3,sharpen,clahe:8 or --pipeline file.txt (see imgproc/pipeline.h)
+    std::string spec = DEFAULT_PIPELINE;
+    std::string spec_file;
+    bool crop_lesion = false;
+    std::string shm_name;
+    int shm_slots = 16;
+    int shm_slot_mb = 4;
+    std::string tensor_type, tensor_mean, tensor_std;
+    std::string model_path, scores_path = "scores.csv";
+    BatchOptions batch_options;
+    int calibration_images = 0;
+    std::string socket_path;
+    int serve_workers = 0;
+    bool watching = false;
+    bool stdio_stream = false;
+    std::string errors_path;
+    std::string on_error = "skip";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--crop-lesion")
+            crop_lesion = true;
+        else if (arg == "--ops" && i + 1 < argc)
+            spec = argv[++i];
+        else if (arg == "--pipeline" && i + 1 < argc)
+            spec_file = argv[++i];
+        else if (arg == "--shm" && i + 1 < argc)
+            shm_name = argv[++i];
+        else if (arg == "--shm-slots" && i + 1 < argc)
+            shm_slots = atoi(argv[++i]);
+        else if (arg == "--shm-slot-mb" && i + 1 < argc)
+            shm_slot_mb = atoi(argv[++i]);
+        else if (arg == "--tensor" && i + 1 < argc)
+            tensor_type = argv[++i];
+        else if (arg == "--mean" && i + 1 < argc)
+            tensor_mean = argv[++i];
+        else if (arg == "--std" && i + 1 < argc)
+            tensor_std = argv[++i];
+        else if (arg == "--classify" && i + 1 < argc)
+            model_path = argv[++i];
+        else if (arg == "--scores" && i + 1 < argc)
+            scores_path = argv[++i];
+        else if (arg == "--batch" && i + 1 < argc)
+            batch_options.max_batch = atoi(argv[++i]);
+        else if (arg == "--max-latency" && i + 1 < argc)
+            batch_options.max_latency_ms = atof(argv[++i]);
+        else if (arg == "--int8" && i + 1 < argc)
+            calibration_images = atoi(argv[++i]);
+        else if (arg == "--serve" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (arg == "--serve-workers" && i + 1 < argc)
+            serve_workers = atoi(argv[++i]);
+        else if (arg == "--watch")
+            watching = true;
+        else if (arg == "--stream")
+            stdio_stream = true;
+        else if (arg == "--errors" && i + 1 < argc)
+            errors_path = argv[++i];
+        else if (arg == "--retries" && i + 1 < argc)
+            retries = atoi(argv[++i]);
+        else if (arg == "--on-error" && i + 1 < argc)
+            on_error = argv[++i];
+        else if (arg == "--sandbox")
+            sandboxed = true;
+    }
+
+    if (on_error != "skip" && on_error != "stop")
+    {
+        std::cerr << "--on-error takes skip or stop, not " << on_error << std::endl;
+        return -1;
+    }
+    stop_on_error = on_error == "stop";
+    // Service clients get a status per request and decide what to retry themselves
+    if ((stdio_stream || !socket_path.empty()) && (!errors_path.empty() || retries > 0 || stop_on_error))
+    {
+        std::cerr << "--errors, --retries and --on-error apply to folders; with --serve / --stream each response "
+                     "carries its status"
+                  << std::endl;
+        return -1;
+    }
+
+    std::string error;
+    bool parsed = spec_file.empty() ? parse_pipeline(spec, pipeline, error) : load_pipeline(spec_file, pipeline, error);
+    if (!parsed)
+    {
+        std::cerr << "Invalid pipeline: " << error << std::endl;
+        return -1;
+    }
+
+    // Crop to the lesion before the expensive stages: right after grayscale if the pipeline has it, else first (the
+    // detection then works on the colour image, which stays colour)
+    if (crop_lesion)
+    {
+        Pipeline crop;
+        parse_pipeline("crop-lesion", crop, error);
+        auto at = std::find_if(pipeline.stages.begin(), pipeline.stages.end(),
+                               [](const Stage &stage) { return stage.kind == STAGE_GRAY; });
+        at = at == pipeline.stages.end() ? pipeline.stages.begin() : at + 1;
+        pipeline.stages.insert(at, crop.stages.begin(), crop.stages.end());
+        optimise_pipeline(pipeline);
+    }
+    // stdout carries the results with --stream, so report on stderr
+    std::ostream &report = stdio_stream ? std::cerr : std::cout;
+    report << "Pipeline:\n" << pipeline.describe();
+
+    // --stream: requests on stdin, responses on stdout, same protocol as --serve
+    if (stdio_stream)
+    {
+        ServiceOptions service;
+        service.pipeline = pipeline;
+        service.sandbox = sandboxed;
+        auto start_time = high_resolution_clock::now();
+        size_t served = run_stream(0, 1, service);
+        auto elapsed_time = duration_cast<milliseconds>(high_resolution_clock::now() - start_time).count();
+        report << "Streamed " << served << " images in " << elapsed_time << " ms" << std::endl;
+        return 0;
+    }
+
+    // --serve PATH: stay up and run requests from a Unix domain socket (see imgproc/service.h)
+    if (!socket_path.empty())
+    {
+        ServiceOptions service;
+        service.pipeline = pipeline;
+        service.workers = serve_workers;
+        service.sandbox = sandboxed;
+        std::cout << "Serving on " << socket_path << std::endl;
+        if (!run_service(socket_path, service, error))
+        {
+            std::cerr << "Error starting service: " << error << std::endl;
+            return -1;
+        }
+        std::cout << "Service stopped" << std::endl;
+        return 0;
+    }
+
+    if (!errors_path.empty())
+    {
+        error_log.open(errors_path);
+        if (!error_log)
+        {
+            std::cerr << "Error opening " << errors_path << std::endl;
+            return -1;
+        }
+        error_log << "path,status,reason\n";
+    }
+
     const std::string input_folder = "melanomaDataset/melanoma_cancer_dataset"; // Replace with your input folder path
     const std::string output_folder = "outputDataset";                          // Replace with your output folder path
 
-    // Create the root output directory
-    _mkdir(output_folder.c_str());
+    if (!tensor_type.empty())
+    {
+        if (shm_name.empty())
+        {
+            std::cerr << "--tensor needs --shm" << std::endl;
+            return -1;
+        }
+        if (!parse_tensor_format(tensor_type, tensor_mean, tensor_std, tensor_format, error))
+        {
+            std::cerr << "Invalid tensor format: " << error << std::endl;
+            return -1;
+        }
+        tensor_output = true;
+    }
+
+    if (!model_path.empty())
+    {
+        if (!load_model(model_path, model, error))
+        {
+            std::cerr << "Error loading model: " << error << std::endl;
+            return -1;
+        }
+        if (calibration_images > 0)
+        {
+            if (!calibrate_int8(input_folder, calibration_images, error))
+            {
+                std::cerr << "Error quantising model: " << error << std::endl;
+                return -1;
+            }
+            std::cout << "Quantised to INT8, calibrated on " << calibration_images << " images" << std::endl;
+        }
+        scores.open(scores_path);
+        if (!scores)
+        {
+            std::cerr << "Error opening " << scores_path << std::endl;
+            return -1;
+        }
+        scores << "path,probability\n";
+        scheduler = start_batch_scheduler(model, batch_options,
+                                          [](const std::string &name, const float *output)
+                                          { scores << name << ',' << output[0] << '\n'; });
+        classifying = true;
+        std::cout << "Classifying with " << model_path << " (" << model.height << "x" << model.width << "x"
+                  << model.channels << ", " << model.layers.size() << " layers) in batches of up to "
+                  << batch_options.max_batch << " within " << batch_options.max_latency_ms << " ms, scores in "
+                  << scores_path << std::endl;
+    }
+
+    if (!shm_name.empty())
+    {
+        if (!create_shared_ring(shm_name, shm_slots, static_cast<size_t>(shm_slot_mb) << 20, ring, error))
+        {
+            std::cerr << "Error creating shared memory ring: " << error << std::endl;
+            return -1;
+        }
+        streaming = true;
+        std::cout << "Streaming to shared memory " << shm_name << " (" << shm_slots << " slots of " << shm_slot_mb
+                  << " MB)" << std::endl;
+    }
+    else if (!classifying)
+    {
+        // Create the root output directory
+        make_directory(output_folder.c_str());
+    }
 
     auto start_time = high_resolution_clock::now();
 
-    // Process the directory
-    process_directory(input_folder, output_folder, start_time);
+    if (watching)
+    {
+        // --watch: process each image as it lands in the input folder instead of the folder as it is now
+        std::cout << "Watching " << input_folder << " for new images" << std::endl;
+        bool watched = watch_directory(
+            input_folder,
+            [&](const std::string &input_path)
+            {
+                auto landed = high_resolution_clock::now();
+                const std::string relative = input_path.substr(input_folder.size());
+                const std::string output_path = output_folder + relative;
+                if (!streaming && !classifying)
+                {
+                    // Create any output directories the new file needs
+                    for (size_t slash = relative.find('/', 1); slash != std::string::npos;
+                         slash = relative.find('/', slash + 1))
+                        make_directory((output_folder + relative.substr(0, slash)).c_str());
+                }
+                if (process_file(input_path, output_path, start_time))
+                {
+                    auto elapsed = duration<double, std::milli>(high_resolution_clock::now() - landed).count();
+                    std::cout << "Processed " << input_path << " in " << elapsed << " ms" << std::endl;
+                }
+                else if (stop_processing)
+                {
+                    raise(SIGTERM); // --on-error stop: ends watch_directory
+                }
+            },
+            error);
+        if (!watched)
+        {
+            std::cerr << "Error watching " << input_folder << ": " << error << std::endl;
+            return -1;
+        }
+    }
+    else
+    {
+        // Process the directory
+        process_directory(input_folder, output_folder, start_time);
+    }
+
+    if (streaming)
+        close_shared_ring(ring);
+    BatchStats batch_stats;
+    if (classifying)
+        stop_batch_scheduler(scheduler, &batch_stats);
 
     auto end_time = high_resolution_clock::now();
     auto duration = duration_cast<milliseconds>(end_time - start_time).count();
     std::cout << "Total time spent: " << duration << " ms" << std::endl;
+    if (decoded_pixels > 0)
+    {
+        std::cout << "Pixels processed: " << processed_pixels << " of " << decoded_pixels << " decoded ("
+                  << 100.0 * processed_pixels / decoded_pixels << "%)" << std::endl;
+    }
+    if (batch_stats.batches > 0)
+    {
+        std::cout << "Classified " << batch_stats.images << " images in " << batch_stats.batches << " batches ("
+                  << batch_stats.full_batches << " full, longest wait " << batch_stats.max_wait_ms << " ms)"
+                  << std::endl;
+    }
 
+    if (failed_count > 0)
+    {
+        std::cout << failed_count << " images failed" << (stop_processing ? ", stopped at the first" : ", skipped")
+                  << (errors_path.empty() ? "" : " (see " + errors_path + ")") << std::endl;
+        return 1;
+    }
     std::cout << "Processing completed successfully!" << std::endl;
     return 0;
 }